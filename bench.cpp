@@ -0,0 +1,231 @@
+// Throughput benchmarks for the engine in fraction.cpp: time to n digits and
+// allocations per digit for the constants, the elementary functions (the
+// trigonometric ones across their argument range) and the arithmetic
+// tensors, at several precisions.
+//
+// usage: fractions_bench [-jthreads] [-cdir] [-astrategy] [-p] [digits...]   (default 100 300 1000)
+//
+// -j evaluates with a Pool of that many workers. -c adds a case for pi
+// taken from a ConstantCache in dir, filled to the highest precision first,
+// and fails unless a second cache on dir reads those digits back.
+// -a absorbs by the named Strategy rather than the default. -p evaluates
+// with eapprox to within 2^-digits instead of with sem to `digits` digits.
+//
+// Prints one JSON object per line and case, so runs can be diffed or
+// collected to track regressions.
+#define FRACTIONS_NO_MAIN
+#include "fraction.cpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+
+// every heap allocation in the process, BigInt limbs and std::function
+// captures included. Nodes allocated in an arena are counted by Stats.
+static size_t heapAllocs = 0;
+
+// The replacements below cover every form of global new and delete, so
+// nothing pairs the library's new with our free or the other way round.
+// They stay out of line: inlined into a caller, GCC would see free() on a
+// pointer from a new-expression and warn (-Wmismatched-new-delete).
+#define BENCH_NOINLINE __attribute__((noinline))
+
+static void *countedAlloc(size_t size, size_t align) noexcept {
+    heapAllocs++;
+    size = size ? size : 1;
+    if (align <= alignof(std::max_align_t)) {
+        return malloc(size);
+    }
+    return aligned_alloc(align, (size + align - 1) / align * align);
+}
+
+static void *countedAllocOrThrow(size_t size, size_t align) {
+    if (void *p = countedAlloc(size, align)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+BENCH_NOINLINE void *operator new(size_t size) { return countedAllocOrThrow(size, 0); }
+
+BENCH_NOINLINE void *operator new[](size_t size) { return countedAllocOrThrow(size, 0); }
+
+BENCH_NOINLINE void *operator new(size_t size, std::align_val_t al) { return countedAllocOrThrow(size, (size_t) al); }
+
+BENCH_NOINLINE void *operator new[](size_t size, std::align_val_t al) { return countedAllocOrThrow(size, (size_t) al); }
+
+BENCH_NOINLINE void *operator new(size_t size, const std::nothrow_t &) noexcept { return countedAlloc(size, 0); }
+
+BENCH_NOINLINE void *operator new[](size_t size, const std::nothrow_t &) noexcept { return countedAlloc(size, 0); }
+
+BENCH_NOINLINE void *operator new(size_t size, std::align_val_t al, const std::nothrow_t &) noexcept {
+    return countedAlloc(size, (size_t) al);
+}
+
+BENCH_NOINLINE void *operator new[](size_t size, std::align_val_t al, const std::nothrow_t &) noexcept {
+    return countedAlloc(size, (size_t) al);
+}
+
+BENCH_NOINLINE void operator delete(void *p) noexcept { free(p); }
+
+BENCH_NOINLINE void operator delete[](void *p) noexcept { free(p); }
+
+BENCH_NOINLINE void operator delete(void *p, size_t) noexcept { free(p); }
+
+BENCH_NOINLINE void operator delete[](void *p, size_t) noexcept { free(p); }
+
+BENCH_NOINLINE void operator delete(void *p, std::align_val_t) noexcept { free(p); }
+
+BENCH_NOINLINE void operator delete[](void *p, std::align_val_t) noexcept { free(p); }
+
+BENCH_NOINLINE void operator delete(void *p, size_t, std::align_val_t) noexcept { free(p); }
+
+BENCH_NOINLINE void operator delete[](void *p, size_t, std::align_val_t) noexcept { free(p); }
+
+BENCH_NOINLINE void operator delete(void *p, const std::nothrow_t &) noexcept { free(p); }
+
+BENCH_NOINLINE void operator delete[](void *p, const std::nothrow_t &) noexcept { free(p); }
+
+BENCH_NOINLINE void operator delete(void *p, std::align_val_t, const std::nothrow_t &) noexcept { free(p); }
+
+BENCH_NOINLINE void operator delete[](void *p, std::align_val_t, const std::nothrow_t &) noexcept { free(p); }
+
+struct BenchCase {
+    const char *name;
+    std::function<const Expr *()> build;
+};
+
+const Expr *evec(num p, num q) { return mk<VecExpr>(Vec(p, q)); }
+
+const Expr *etensor(const Tensor &t, const Expr *x, const Expr *y) {
+    return mk<TensorExpr>(t, ExprThunk::thunkify(x), ExprThunk::thunkify(y));
+}
+
+std::vector<BenchCase> benchCases() {
+    return {
+            {"epi",               []() { return epi(); }},
+            {"ee",                []() { return ee(); }},
+            {"esqrtrat(2/1)",     []() { return esqrtrat(2, 1); }},
+            {"esqrtspos(3/2)",    []() { return esqrtspos(evec(3, 2)); }},
+            {"elogpos(3/2)",      []() { return elogpos(evec(3, 2)); }},
+            {"esqrtspos(ee)",     []() { return esqrtspos(ee()); }},
+            {"elogpos(ee)",       []() { return elogpos(ee()); }},
+            {"eexp(1/3)",         []() { return eexp(evec(1, 3)); }},
+            {"eexp(ee)",          []() { return eexp(ee()); }},
+            {"etan(1/10)",        []() { return etan(evec(1, 10)); }},
+            {"etan(1)",           []() { return etan(evec(1, 1)); }},
+            {"etan(10)",          []() { return etan(evec(10, 1)); }},
+            {"etan(10^6)",        []() { return etan(evec(1000000, 1)); }},
+            {"etan(ee)",          []() { return etan(ee()); }},
+            {"esin(1)",           []() { return esin(evec(1, 1)); }},
+            {"ecos(10^6)",        []() { return ecos(evec(1000000, 1)); }},
+            {"earctan(1/10)",     []() { return earctan(evec(1, 10)); }},
+            {"earctan(1)",        []() { return earctan(evec(1, 1)); }},
+            {"earctan(10^6)",     []() { return earctan(evec(1000000, 1)); }},
+            {"earctan(ee)",       []() { return earctan(ee()); }},
+            {"tadd(epi,ee)",      []() { return etensor(tadd, epi(), ee()); }},
+            {"tsub(epi,ee)",      []() { return etensor(tsub, epi(), ee()); }},
+            {"tmul(epi,ee)",      []() { return etensor(tmul, epi(), ee()); }},
+            {"tdiv(epi,ee)",      []() { return etensor(tdiv, epi(), ee()); }},
+            {"x*x+x (x=epi)",     []() {
+                const Expr *x = epi();
+                return etensor(tadd, etensor(tmul, x, x), x);
+            }},
+            {"tadd(epi,ee/2^200)", []() {
+                return etensor(tadd, epi(), etensor(tdiv, ee(), evec(num(1) << 200, 1)));
+            }},
+    };
+}
+
+// one sem run to `digits` digits on a freshly built expression; repeated
+// until it has taken at least minSeconds in total.
+void bench(const BenchCase &c, int digits, int threads, bool directed, double minSeconds = 0.2) {
+    using clock = std::chrono::steady_clock;
+    double seconds = 0;
+    size_t allocs = 0, nodes = 0, reps = 0, terms = 0, emitted = 0, bitsSaved = 0;
+    int maxBits = 0;
+    do {
+        Stats::get().reset();
+        const size_t allocs0 = heapAllocs;
+        const clock::time_point start = clock::now();
+        {
+            ArenaScope scope(Arena::evaluation());
+            if (directed) {
+                eapprox(c.build(), digits);
+            } else {
+                sem(c.build(), digits);
+            }
+        }
+        seconds += std::chrono::duration<double>(clock::now() - start).count();
+        allocs += heapAllocs - allocs0;
+        nodes += Stats::get().nodes;
+        bitsSaved += Stats::get().scaleBitsSaved;
+        terms += Stats::get().strategyTerms[Strategy::current()->id];
+        emitted += Stats::get().strategyDigits[Strategy::current()->id];
+        maxBits = Stats::get().maxCoeffBits;
+        reps++;
+    } while (seconds < minSeconds);
+
+    const double perRun = seconds / reps;
+    printf("{\"bench\": \"%s\", \"digits\": %d, \"mode\": \"%s\", \"threads\": %d, \"strategy\": \"%s\", \"reps\": %zu, "
+           "\"seconds\": %.9f, \"digits_per_sec\": %.1f, \"heap_allocs_per_digit\": %.2f, "
+           "\"nodes_per_digit\": %.2f, \"digits_per_term\": %.3f, \"scale_bits_saved_per_digit\": %.2f, "
+           "\"max_coeff_bits\": %d}\n",
+           c.name, digits, directed ? "eapprox" : "sem", threads, Strategy::current()->name, reps, perRun, digits / perRun,
+           (double) allocs / reps / digits, (double) nodes / reps / digits,
+           terms ? (double) emitted / terms : 0.0, (double) bitsSaved / reps / digits, maxBits);
+    fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+    std::vector<int> precisions;
+    int threads = 0;
+    const char *cacheDir = nullptr;
+    const Strategy *strategy = Strategy::current();
+    bool directed = false;
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "-j", 2) == 0) {
+            threads = atoi(argv[i] + 2);
+        } else if (strncmp(argv[i], "-c", 2) == 0) {
+            cacheDir = argv[i] + 2;
+        } else if (strcmp(argv[i], "-p") == 0) {
+            directed = true;
+        } else if (strncmp(argv[i], "-a", 2) == 0) {
+            if (!(strategy = Strategy::byName(argv[i] + 2))) {
+                fprintf(stderr, "unknown strategy %s\n", argv[i] + 2);
+                return 1;
+            }
+        } else {
+            precisions.push_back(atoi(argv[i]));
+        }
+    }
+    if (precisions.empty()) {
+        precisions = {100, 300, 1000};
+    }
+    std::unique_ptr<Pool> pool(threads > 0 ? new Pool(threads) : nullptr);
+    PoolScope scope(pool.get());
+    StrategyScope absorbing(strategy);
+    std::vector<BenchCase> cases = benchCases();
+    std::unique_ptr<ConstantCache> cache(cacheDir ? new ConstantCache(cacheDir) : nullptr);
+    if (cache) {
+        const int most = *std::max_element(precisions.begin(), precisions.end());
+        cache->constant("pi", []() { return epi(); }, most + 64);
+        // a second cache on the directory, as after a restart, has to read
+        // those digits back rather than compute them again.
+        Stats::get().reset();
+        ConstantCache(cacheDir).constant("pi", []() { return epi(); }, most + 64);
+        if (Stats::get().cacheComputed != 0 || (int) Stats::get().cacheRead < most + 64) {
+            fprintf(stderr, "%s: pi was not read back from the cache\n", cacheDir);
+            return 1;
+        }
+        cases.push_back({"epi (cached)", [&cache, most]() {
+            return cache->constant("pi", []() { return epi(); }, most + 64);
+        }});
+    }
+    for (const BenchCase &c : cases) {
+        for (int digits : precisions) {
+            bench(c, digits, threads, directed);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,181 @@
+// Randomized checks of BigInt in fraction.cpp: every operation on operands
+// of up to two limbs against the same operation on __int128, and the
+// identities division, gcd and the shifts have to satisfy on multi-limb
+// operands, where there is nothing wider to compare with. The operands
+// lean on the edges: 0, +-1, LLONG_MIN and LLONG_MAX, the limb boundaries
+// +-2^32 and +-2^64, and runs of all ones.
+//
+// usage: fractions_bigint_test [cases] [seed]   (default 20000 1)
+//
+// Prints the first mismatch and exits 1, or a summary and exits 0.
+#define FRACTIONS_NO_MAIN
+#include "fraction.cpp"
+
+using i128 = __int128;
+
+static uint64_t rngState;
+
+// splitmix64, so a seed reproduces a run.
+static uint64_t next64() {
+    uint64_t z = (rngState += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static int below(int n) { return (int) (next64() % (uint64_t) n); }
+
+// a magnitude of exactly `bits` bits: random, all ones, or a lone top bit
+// with a few low ones, so that carries and borrows run across limbs.
+static BigInt::Mag magnitude(int bits) {
+    BigInt::Mag m((bits + 31) / 32, 0);
+    const int kind = below(4);
+    for (BigInt::limb &l : m) {
+        l = kind == 1 ? ~0u : kind == 2 ? 0u : (BigInt::limb) next64();
+    }
+    if (kind == 2 && !m.empty()) { m[0] = (BigInt::limb) below(4); }
+    if (bits % 32 != 0) { m.back() &= (1u << bits % 32) - 1; }
+    if (bits > 0) { m.back() |= 1u << (bits - 1) % 32; }
+    return m;
+}
+
+static BigInt fromI128(i128 v) {
+    const bool neg = v < 0;
+    unsigned __int128 u = neg ? -(unsigned __int128) v : (unsigned __int128) v;
+    BigInt::Mag m;
+    for (; u != 0; u >>= 32) { m.push_back((BigInt::limb) u); }
+    return BigInt::fromMagnitude(neg, m);
+}
+
+static std::string str128(i128 v) {
+    if (v == 0) { return "0"; }
+    unsigned __int128 u = v < 0 ? -(unsigned __int128) v : (unsigned __int128) v;
+    std::string s;
+    for (; u != 0; u /= 10) { s += (char) ('0' + (int) (u % 10)); }
+    if (v < 0) { s += '-'; }
+    return std::string(s.rbegin(), s.rend());
+}
+
+// an operand of at most `maxBits` bits, often one of the edges.
+static i128 operand(int maxBits) {
+    static const i128 two32 = (i128) 1 << 32, two63 = (i128) 1 << 63, two64 = (i128) 1 << 64;
+    static const i128 edges[] = {0, 1, -1, 2, LLONG_MAX, LLONG_MIN, (i128) LLONG_MIN + 1, (i128) LLONG_MAX + 1,
+                                 two32 - 1, two32, two32 + 1, -two32, two63 - 1, -two63 - 1,
+                                 two64 - 1, two64, -two64 + 1, -two64};
+    i128 v;
+    if (below(3) == 0) {
+        v = edges[below(sizeof(edges) / sizeof(edges[0]))];
+    } else {
+        const int bits = below(maxBits + 1);
+        v = 0;
+        BigInt::Mag m = magnitude(bits);
+        for (size_t i = m.size(); i-- > 0;) { v = v << 32 | m[i]; }
+        if (below(2) == 0) { v = -v; }
+    }
+    const i128 limit = (i128) 1 << maxBits;
+    return v > limit || v < -limit ? v % limit : v;
+}
+
+static BigInt multiLimb() {
+    const int bits = below(6) == 0 ? 32 * (1 + below(8)) : 1 + below(600);
+    return BigInt::fromMagnitude(below(2) == 0, magnitude(bits));
+}
+
+static size_t checks = 0;
+
+static bool check(bool ok, const char *what, const BigInt &a, const BigInt &b, const std::string &got,
+                  const std::string &want) {
+    checks++;
+    if (!ok) {
+        printf("%s: a = %s, b = %s: got %s, want %s\n", what, a.str().c_str(), b.str().c_str(), got.c_str(),
+               want.c_str());
+    }
+    return ok;
+}
+
+static bool same(const char *what, const BigInt &a, const BigInt &b, const BigInt &got, i128 want) {
+    const std::string g = got.str(), w = str128(want);
+    return check(g == w, what, a, b, g, w);
+}
+
+static bool holds(const char *what, const BigInt &a, const BigInt &b, bool ok) {
+    return check(ok, what, a, b, "false", "true");
+}
+
+static int sgn128(i128 v) { return (v > 0) - (v < 0); }
+
+// the operations on x and y, both within 2^64 so that every result fits;
+// products and left shifts only for operands within 2^63.
+static bool againstI128(i128 x, i128 y, int k) {
+    const BigInt a = fromI128(x), b = fromI128(y);
+    bool ok = same("str", a, b, a, x) && same("+", a, b, a + b, x + y) && same("-", a, b, a - b, x - y) &&
+              same("neg", a, b, -a, -x) && same("abs", a, b, abs(a), x < 0 ? -x : x) &&
+              same(">>", a, b, a >> k, x < 0 ? -(-x >> k) : x >> k) &&
+              holds("compare", a, b, compare(a, b) == (x > y) - (x < y)) &&
+              holds("sign", a, b, a.sign() == sgn128(x));
+    if (ok && x >= -((i128) 1 << 63) && x <= (i128) 1 << 63 && y >= -((i128) 1 << 63) && y <= (i128) 1 << 63) {
+        const int j = k % 64;
+        ok = same("*", a, b, a * b, x * y) && same("<<", a, b, a << j, x < 0 ? -(-x << j) : x << j);
+    }
+    if (ok && y != 0) {
+        ok = same("/", a, b, a / b, x / y) && same("%", a, b, a % b, x % y);
+    }
+    if (ok) {
+        i128 p = x < 0 ? -x : x, q = y < 0 ? -y : y;
+        while (q != 0) {
+            const i128 r = p % q;
+            p = q;
+            q = r;
+        }
+        ok = same("gcd", a, b, gcd(a, b), p);
+    }
+    return ok;
+}
+
+// what truncating division, gcd and the shifts have to satisfy, for any a
+// and b.
+static bool identities(const BigInt &a, const BigInt &b, int k) {
+    const BigInt one = 1, pow = one << k;
+    bool ok = holds("a + b - b", a, b, a + b - b == a) && holds("a * b == b * a", a, b, a * b == b * a) &&
+              holds("(a + b) * b", a, b, (a + b) * b == a * b + b * b) &&
+              holds("(a << k) >> k", a, b, (a << k) >> k == a) &&
+              holds("a >> k", a, b, (a >> k) == a / pow) &&
+              holds("a << k", a, b, (a << k) == a * pow);
+    if (ok && b != 0) {
+        const BigInt q = a / b, r = a % b;
+        ok = holds("a == q b + r", a, b, q * b + r == a) && holds("|r| < |b|", a, b, abs(r) < abs(b)) &&
+             holds("sign of r", a, b, r == 0 || r.sign() == a.sign()) &&
+             holds("(a * b) / b", a, b, (a * b) / b == a && (a * b) % b == 0);
+    }
+    if (ok) {
+        const BigInt g = gcd(a, b);
+        ok = holds("gcd >= 0", a, b, g >= 0) && holds("gcd(a, b) == gcd(b, a)", a, b, g == gcd(b, a));
+        if (ok && g != 0) {
+            ok = holds("gcd divides", a, b, a % g == 0 && b % g == 0) &&
+                 holds("gcd is greatest", a, b, gcd(a / g, b / g) == 1);
+        } else if (ok) {
+            ok = holds("gcd(0, 0)", a, b, a == 0 && b == 0);
+        }
+    }
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    const long cases = argc > 1 ? atol(argv[1]) : 20000;
+    rngState = argc > 2 ? strtoull(argv[2], nullptr, 10) : 1;
+    for (long i = 0; i < cases; ++i) {
+        const i128 x = operand(64), y = operand(64);
+        if (!againstI128(x, y, below(70))) { return 1; }
+        // multi-limb operands, alone and against small ones, and a common
+        // factor so that gcd has something to find.
+        BigInt a = multiLimb(), b = below(4) == 0 ? fromI128(operand(64)) : multiLimb();
+        if (below(4) == 0) {
+            const BigInt c = multiLimb();
+            a = a * c;
+            b = b * c;
+        }
+        if (!identities(a, b, below(200)) || !identities(b, a, below(200))) { return 1; }
+    }
+    printf("ok: %ld cases, %zu checks\n", cases, checks);
+    return 0;
+}
@@ -1,20 +1,673 @@
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <limits.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <deque>
 #include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
 #include <utility>
+#include <variant>
 #include <vector>
 
 using namespace std;
 using ll = long long;
-using num = ll;
 
-struct Vec;
-struct Mat;
-struct Tensor;
+// folds v into the running hash h.
+inline size_t hashMix(size_t h, size_t v) {
+    return h ^ (v + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2));
+}
+
+// ===Arbitrary precision integers===
+// Coefficients of the LFTs grow without bound as we absorb terms, so they
+// cannot live in machine words. BigInt keeps the value inline in `small`
+// as long as it fits in a long long, and only spills into heap allocated
+// 32-bit limbs (sign-magnitude, least significant first) once an operation
+// overflows. Every slow-path result is demoted back to the inline form when
+// it fits again, so the early terms of a series never touch the heap.
+class BigInt {
+public:
+    using limb = uint32_t;
+    using dlimb = uint64_t;
+    using Mag = std::vector<limb>;
+
+    BigInt(ll v = 0) : small(v) {};
+
+    bool isSmall() const { return limbs.empty(); }
+
+    int sign() const {
+        if (isSmall()) { return (small > 0) - (small < 0); }
+        return neg ? -1 : 1;
+    }
+
+    bool isZero() const { return isSmall() && small == 0; }
+
+    bool isEven() const {
+        return isSmall() ? (small & 1) == 0 : (limbs[0] & 1) == 0;
+    }
+
+    // number of trailing zero bits. *this must be nonzero.
+    int ctz() const {
+        assert(!isZero());
+        if (isSmall()) { return __builtin_ctzll((unsigned long long) small); }
+        int out = 0;
+        size_t i = 0;
+        for (; limbs[i] == 0; ++i) { out += 32; }
+        return out + __builtin_ctz(limbs[i]);
+    }
+
+    // number of bits in the magnitude; 0 for 0.
+    int bitLength() const {
+        if (isSmall()) {
+            const unsigned long long m = smallMag();
+            return m == 0 ? 0 : 64 - __builtin_clzll(m);
+        }
+        return 32 * (int) (limbs.size() - 1) + (32 - __builtin_clz(limbs.back()));
+    }
+
+    std::string str() const;
+
+    // *this / 2^shift as a double, to within a relative error of 2^-52
+    // unless that underflows.
+    double scaled(int shift) const {
+        if (isSmall()) { return __builtin_ldexp((double) small, -shift); }
+        // the top 64 bits; they span at most three limbs.
+        const int k = std::max(0, bitLength() - 64);
+        unsigned __int128 cur = 0;
+        for (size_t i = limbs.size(); i-- > (size_t) k / 32;) { cur = (cur << 32) | limbs[i]; }
+        const double m = __builtin_ldexp((double) (unsigned long long) (cur >> (k % 32)), k - shift);
+        return neg ? -m : m;
+    }
+
+    // sign and magnitude, for checkpoints.
+    bool negative() const { return sign() < 0; }
+
+    Mag magnitude() const { return mag(); }
+
+    static BigInt fromMagnitude(bool neg, Mag m) { return fromMag(neg, std::move(m)); }
+
+    // equal values hash equal, since a value that fits is always inline.
+    size_t hash() const {
+        if (isSmall()) { return hashMix(0, (size_t) small); }
+        size_t h = neg;
+        for (limb l : limbs) { h = hashMix(h, l); }
+        return h;
+    }
+
+    friend BigInt operator+(const BigInt &a, const BigInt &b) {
+        ll r;
+        if (a.isSmall() && b.isSmall() && !__builtin_add_overflow(a.small, b.small, &r)) {
+            return BigInt(r);
+        }
+        return addSlow(a.isNeg(), a.mag(), b.isNeg(), b.mag());
+    }
+
+    friend BigInt operator-(const BigInt &a, const BigInt &b) {
+        ll r;
+        if (a.isSmall() && b.isSmall() && !__builtin_sub_overflow(a.small, b.small, &r)) {
+            return BigInt(r);
+        }
+        return addSlow(a.isNeg(), a.mag(), !b.isNeg() && !b.isZero(), b.mag());
+    }
+
+    friend BigInt operator*(const BigInt &a, const BigInt &b) {
+        ll r;
+        if (a.isSmall() && b.isSmall() && !__builtin_mul_overflow(a.small, b.small, &r)) {
+            return BigInt(r);
+        }
+        return fromMag(a.isNeg() != b.isNeg(), mulMag(a.mag(), b.mag()));
+    }
+
+    // truncating division, same rounding as the builtin integer types.
+    friend BigInt operator/(const BigInt &a, const BigInt &b) {
+        assert(!b.isZero());
+        if (a.isSmall() && b.isSmall() && !(a.small == LLONG_MIN && b.small == -1)) {
+            return BigInt(a.small / b.small);
+        }
+        Mag q, r;
+        divmodMag(a.mag(), b.mag(), q, r);
+        return fromMag(a.isNeg() != b.isNeg(), std::move(q));
+    }
+
+    friend BigInt operator%(const BigInt &a, const BigInt &b) {
+        assert(!b.isZero());
+        if (a.isSmall() && b.isSmall()) {
+            return BigInt(b.small == -1 ? 0 : a.small % b.small);
+        }
+        Mag q, r;
+        divmodMag(a.mag(), b.mag(), q, r);
+        return fromMag(a.isNeg(), std::move(r));
+    }
+
+    friend BigInt operator-(const BigInt &a) { return BigInt(0) - a; }
+
+    // shifts act on the magnitude, so >> truncates towards zero.
+    friend BigInt operator<<(const BigInt &a, int k) {
+        assert(k >= 0);
+        if (a.isSmall() && a.bitLength() + k < 63) {
+            const ll m = (ll) (a.smallMag() << k);
+            return BigInt(a.small < 0 ? -m : m);
+        }
+        return fromMag(a.isNeg(), shlMag(a.mag(), k));
+    }
+
+    friend BigInt operator>>(const BigInt &a, int k) {
+        assert(k >= 0);
+        if (a.isSmall()) {
+            // past k = 0 the magnitude fits, even LLONG_MIN's.
+            if (k == 0) { return a; }
+            const ll m = k >= 64 ? 0 : (ll) (a.smallMag() >> k);
+            return BigInt(a.small < 0 ? -m : m);
+        }
+        return fromMag(a.isNeg(), shrMag(a.mag(), k));
+    }
+
+    BigInt &operator+=(const BigInt &b) { return *this = *this + b; }
+
+    BigInt &operator-=(const BigInt &b) { return *this = *this - b; }
+
+    BigInt &operator*=(const BigInt &b) { return *this = *this * b; }
+
+    // always nonnegative; gcd(0, 0) = 0.
+    friend BigInt gcd(const BigInt &a, const BigInt &b) {
+        if (a.isSmall() && b.isSmall()) {
+            return fromU64(gcdu(a.smallMag(), b.smallMag()));
+        }
+        // Lehmer's Euclid while the operands are multi-word, binary gcd once
+        // they fit.
+        Mag x = a.mag(), y = b.mag();
+        if (cmpMag(x, y) < 0) { std::swap(x, y); }
+        while (!y.empty()) {
+            if (x.size() <= 2) {
+                return fromU64(gcdu(toU64(x), toU64(y)));
+            }
+            lehmerStep(x, y);
+        }
+        return fromMag(false, std::move(x));
+    }
+
+    // one round of Lehmer's algorithm (Knuth volume 2, 4.5.2 L) on x >= y:
+    // run Euclid on the leading 32 bits for as long as the quotients are
+    // certain, then apply the accumulated cosequence to x and y at once. Falls
+    // back to a single long division when no quotient is certain.
+    static void lehmerStep(Mag &x, Mag &y) {
+        const int k = (int) x.size() * 32 - __builtin_clz(x.back()) - 32;
+        long long xh = topBits(x, k), yh = topBits(y, k);
+        long long A = 1, B = 0, C = 0, D = 1;
+        while (yh + C != 0 && yh + D != 0) {
+            const long long q = (xh + A) / (yh + C);
+            if (q != (xh + B) / (yh + D)) { break; }
+            long long t = A - q * C; A = C; C = t;
+            t = B - q * D; B = D; D = t;
+            t = xh - q * yh; xh = yh; yh = t;
+        }
+        if (B == 0) {
+            Mag q, r;
+            divmodMag(x, y, q, r);
+            x = std::move(y);
+            y = std::move(r);
+            return;
+        }
+        Mag nx = combineMag(x, A, y, B);
+        y = combineMag(x, C, y, D);
+        x = std::move(nx);
+    }
+
+    // bits [k, k + 32) of a.
+    static limb topBits(const Mag &a, int k) {
+        const size_t w = k / 32;
+        if (w >= a.size()) { return 0; }
+        dlimb cur = a[w];
+        if (w + 1 < a.size()) { cur |= (dlimb) a[w + 1] << 32; }
+        return (limb) (cur >> (k % 32));
+    }
+
+    // p * a + q * b for |p|, |q| < 2^32 where the result is known to be >= 0.
+    static Mag combineMag(const Mag &a, long long p, const Mag &b, long long q) {
+        Mag out(std::max(a.size(), b.size()) + 1);
+        __int128 carry = 0;
+        for (size_t i = 0; i < out.size(); ++i) {
+            carry += (__int128) p * (i < a.size() ? a[i] : 0) + (__int128) q * (i < b.size() ? b[i] : 0);
+            out[i] = (limb) carry;
+            carry >>= 32;
+        }
+        assert(carry == 0);
+        trim(out);
+        return out;
+    }
+
+    // binary gcd (Stein): strip the common power of two with one ctz, then
+    // only shifts and subtractions.
+    static unsigned long long gcdu(unsigned long long a, unsigned long long b) {
+        if (a == 0) { return b; }
+        if (b == 0) { return a; }
+        const int shift = __builtin_ctzll(a | b);
+        a >>= __builtin_ctzll(a);
+        do {
+            b >>= __builtin_ctzll(b);
+            if (a > b) { std::swap(a, b); }
+            b -= a;
+        } while (b != 0);
+        return a << shift;
+    }
+
+    friend int compare(const BigInt &a, const BigInt &b) {
+        if (a.isSmall() && b.isSmall()) {
+            return (a.small > b.small) - (a.small < b.small);
+        }
+        const int sa = a.sign(), sb = b.sign();
+        if (sa != sb) { return sa < sb ? -1 : 1; }
+        const int c = cmpMag(a.mag(), b.mag());
+        return sa < 0 ? -c : c;
+    }
+
+    friend bool operator==(const BigInt &a, const BigInt &b) { return compare(a, b) == 0; }
+
+    friend bool operator!=(const BigInt &a, const BigInt &b) { return compare(a, b) != 0; }
+
+    friend bool operator<(const BigInt &a, const BigInt &b) { return compare(a, b) < 0; }
+
+    friend bool operator<=(const BigInt &a, const BigInt &b) { return compare(a, b) <= 0; }
+
+    friend bool operator>(const BigInt &a, const BigInt &b) { return compare(a, b) > 0; }
+
+    friend bool operator>=(const BigInt &a, const BigInt &b) { return compare(a, b) >= 0; }
+
+private:
+    ll small = 0;      // the value, when limbs is empty
+    bool neg = false;  // sign, when limbs is nonempty
+    Mag limbs;         // magnitude, least significant limb first
+
+    bool isNeg() const { return isSmall() ? small < 0 : neg; }
+
+    unsigned long long smallMag() const {
+        return small < 0 ? -(unsigned long long) small : (unsigned long long) small;
+    }
+
+    Mag mag() const {
+        if (!isSmall()) { return limbs; }
+        Mag out;
+        for (unsigned long long m = smallMag(); m != 0; m >>= 32) { out.push_back((limb) m); }
+        return out;
+    }
+
+    static unsigned long long toU64(const Mag &m) {
+        assert(m.size() <= 2);
+        return m.empty() ? 0 : (m.size() == 1 ? m[0] : ((dlimb) m[1] << 32) | m[0]);
+    }
+
+    static BigInt fromU64(unsigned long long v) {
+        Mag m;
+        for (; v != 0; v >>= 32) { m.push_back((limb) v); }
+        return fromMag(false, std::move(m));
+    }
+
+    static void trim(Mag &a) {
+        while (!a.empty() && a.back() == 0) { a.pop_back(); }
+    }
+
+    static BigInt fromMag(bool neg, Mag m) {
+        trim(m);
+        BigInt out;
+        if (m.size() <= 2) {
+            const unsigned long long v = toU64(m);
+            if (v <= (unsigned long long) LLONG_MAX) {
+                out.small = neg ? -(ll) v : (ll) v;
+                return out;
+            } else if (neg && v == (unsigned long long) LLONG_MAX + 1) {
+                out.small = LLONG_MIN;
+                return out;
+            }
+        }
+        out.neg = neg;
+        out.limbs = std::move(m);
+        return out;
+    }
+
+    static int cmpMag(const Mag &a, const Mag &b) {
+        if (a.size() != b.size()) { return a.size() < b.size() ? -1 : 1; }
+        for (size_t i = a.size(); i-- > 0;) {
+            if (a[i] != b[i]) { return a[i] < b[i] ? -1 : 1; }
+        }
+        return 0;
+    }
+
+    static Mag addMag(const Mag &a, const Mag &b) {
+        const Mag &x = a.size() >= b.size() ? a : b;
+        const Mag &y = a.size() >= b.size() ? b : a;
+        Mag out(x.size() + 1);
+        dlimb carry = 0;
+        for (size_t i = 0; i < x.size(); ++i) {
+            carry += (dlimb) x[i] + (i < y.size() ? y[i] : 0);
+            out[i] = (limb) carry;
+            carry >>= 32;
+        }
+        out[x.size()] = (limb) carry;
+        trim(out);
+        return out;
+    }
+
+    // |a| >= |b|
+    static Mag subMag(const Mag &a, const Mag &b) {
+        Mag out(a.size());
+        long long borrow = 0;
+        for (size_t i = 0; i < a.size(); ++i) {
+            long long d = (long long) a[i] - (i < b.size() ? b[i] : 0) - borrow;
+            borrow = d < 0;
+            out[i] = (limb) (d + (borrow << 32));
+        }
+        assert(borrow == 0);
+        trim(out);
+        return out;
+    }
+
+    static Mag mulMag(const Mag &a, const Mag &b) {
+        if (a.empty() || b.empty()) { return {}; }
+        Mag out(a.size() + b.size());
+        for (size_t i = 0; i < a.size(); ++i) {
+            dlimb carry = 0;
+            for (size_t j = 0; j < b.size(); ++j) {
+                carry += (dlimb) a[i] * b[j] + out[i + j];
+                out[i + j] = (limb) carry;
+                carry >>= 32;
+            }
+            out[i + b.size()] = (limb) carry;
+        }
+        trim(out);
+        return out;
+    }
+
+    // divide a in place by a single limb, returning the remainder.
+    static limb divmodSmallMag(Mag &a, limb d) {
+        dlimb rem = 0;
+        for (size_t i = a.size(); i-- > 0;) {
+            const dlimb cur = (rem << 32) | a[i];
+            a[i] = (limb) (cur / d);
+            rem = cur % d;
+        }
+        trim(a);
+        return (limb) rem;
+    }
+
+    // schoolbook long division, Knuth volume 2, algorithm 4.3.1 D.
+    static void divmodMag(const Mag &u, const Mag &v, Mag &q, Mag &r) {
+        assert(!v.empty());
+        if (cmpMag(u, v) < 0) {
+            q.clear();
+            r = u;
+            return;
+        }
+        if (v.size() == 1) {
+            q = u;
+            const limb rem = divmodSmallMag(q, v[0]);
+            r.clear();
+            if (rem) { r.push_back(rem); }
+            return;
+        }
+        const size_t n = v.size(), m = u.size();
+        const int s = __builtin_clz(v.back());
+        const Mag vn = shlMag(v, s);
+        Mag un = shlMag(u, s);
+        un.resize(m + 1, 0);
+        q.assign(m - n + 1, 0);
+        const dlimb base = (dlimb) 1 << 32;
+        for (size_t j = m - n + 1; j-- > 0;) {
+            const dlimb num = ((dlimb) un[j + n] << 32) | un[j + n - 1];
+            dlimb qhat = num / vn[n - 1];
+            dlimb rhat = num % vn[n - 1];
+            while (qhat >= base || qhat * vn[n - 2] > ((rhat << 32) | un[j + n - 2])) {
+                qhat--;
+                rhat += vn[n - 1];
+                if (rhat >= base) { break; }
+            }
+            long long k = 0, t;
+            for (size_t i = 0; i < n; ++i) {
+                const dlimb p = qhat * vn[i];
+                t = (long long) un[i + j] - k - (long long) (p & 0xFFFFFFFFu);
+                un[i + j] = (limb) t;
+                k = (long long) (p >> 32) - (t >> 32);
+            }
+            t = (long long) un[j + n] - k;
+            un[j + n] = (limb) t;
+            q[j] = (limb) qhat;
+            if (t < 0) {
+                q[j]--;
+                dlimb carry = 0;
+                for (size_t i = 0; i < n; ++i) {
+                    carry += (dlimb) un[i + j] + vn[i];
+                    un[i + j] = (limb) carry;
+                    carry >>= 32;
+                }
+                un[j + n] += (limb) carry;
+            }
+        }
+        trim(q);
+        un.resize(n);
+        r = shrMag(un, s);
+    }
+
+    static Mag shlMag(const Mag &a, int k) {
+        if (a.empty()) { return {}; }
+        const int limbShift = k / 32, bitShift = k % 32;
+        Mag out(a.size() + limbShift + 1, 0);
+        for (size_t i = 0; i < a.size(); ++i) {
+            const dlimb cur = (dlimb) a[i] << bitShift;
+            out[i + limbShift] |= (limb) cur;
+            out[i + limbShift + 1] |= (limb) (cur >> 32);
+        }
+        trim(out);
+        return out;
+    }
+
+    static Mag shrMag(const Mag &a, int k) {
+        const size_t limbShift = k / 32;
+        const int bitShift = k % 32;
+        if (limbShift >= a.size()) { return {}; }
+        Mag out(a.size() - limbShift, 0);
+        for (size_t i = 0; i < out.size(); ++i) {
+            dlimb cur = a[i + limbShift];
+            if (i + limbShift + 1 < a.size()) { cur |= (dlimb) a[i + limbShift + 1] << 32; }
+            out[i] = (limb) (cur >> bitShift);
+        }
+        trim(out);
+        return out;
+    }
+
+    static BigInt addSlow(bool aneg, const Mag &a, bool bneg, const Mag &b) {
+        if (aneg == bneg) { return fromMag(aneg, addMag(a, b)); }
+        if (cmpMag(a, b) >= 0) { return fromMag(aneg, subMag(a, b)); }
+        return fromMag(bneg, subMag(b, a));
+    }
+};
+
+std::string BigInt::str() const {
+    if (isSmall()) { return std::to_string(small); }
+    // peel off 9 decimal digits at a time.
+    Mag m = limbs;
+    std::string out;
+    while (!m.empty()) {
+        limb chunk = divmodSmallMag(m, 1000000000);
+        for (int i = 0; i < 9; ++i) {
+            out.push_back('0' + chunk % 10);
+            chunk /= 10;
+            if (m.empty() && chunk == 0) { break; }
+        }
+    }
+    if (neg) { out.push_back('-'); }
+    return std::string(out.rbegin(), out.rend());
+}
+
+std::string to_string(const BigInt &b) { return b.str(); }
+
+BigInt abs(const BigInt &b) { return b.sign() < 0 ? -b : b; }
+
+template<typename T>
+int sgn(const T &x) { return (x > 0) - (x < 0); }
+
+int sgn(const BigInt &x) { return x.sign(); }
+
+ll gcd(ll a, ll b) {
+    return (ll) BigInt::gcdu(a < 0 ? -(unsigned long long) a : a, b < 0 ? -(unsigned long long) b : b);
+}
+
+int bitLength(ll x) {
+    const unsigned long long m = x < 0 ? -(unsigned long long) x : x;
+    return m == 0 ? 0 : 64 - __builtin_clzll(m);
+}
+
+int bitLength(const BigInt &x) { return x.bitLength(); }
+
+size_t hashValue(ll x) { return hashMix(0, (size_t) x); }
+
+size_t hashValue(const BigInt &x) { return x.hash(); }
+
+// ===Floating point filter===
+// Nearly every sign the engine tests is nowhere near zero, so it is first
+// decided on doubles: the BigInts scaled by a common power of two (so that
+// nothing overflows) and combined in floating point, with an error bound
+// that covers the scaling and the arithmetic. Only a value too close to zero
+// to call is recomputed exactly. Build with -DFRACTIONS_FILTER=0 to always
+// compute exactly.
+#ifndef FRACTIONS_FILTER
+#define FRACTIONS_FILTER 1
+#endif
+
+// what filteredSign returns when the approximation cannot decide.
+const int Undecided = 2;
+
+// the sign of a value approximated by x, a sum of a few products of scaled
+// BigInts whose magnitudes add up to `size`. The operands are good to 2^-52
+// relative and each operation adds at most an ulp, so 2^-45 of the size is
+// ample; 2^-1000 absorbs operands that underflowed.
+int filteredSign(double x, double size) {
+    const double err = size * 0x1p-45 + 0x1p-1000;
+    if (x > err) { return 1; }
+    if (x < -err) { return -1; }
+    return Undecided;
+}
+
+// ===Content normalization===
+// An LFT is only defined up to a scalar, so scale() divides every
+// coefficient by their content (the gcd of all entries). Stats counts how
+// many coefficient bits that has removed.
+
+// ===Engine statistics===
+// Always on, and cheap enough to stay that way: a few integer increments per
+// step. They are per thread, so concurrent evaluations neither race nor
+// share cache lines; Stats::get() is the calling thread's.
+struct Stats {
+    size_t absorbed[2] = {0, 0};  // arguments absorbed, by side (a matrix's is side 1)
+    size_t declined[2] = {0, 0};  // ... passed over by the strategy and wrapped in the identity
+    size_t signs[4] = {0, 0, 0, 0};  // sign emissions, indexed by SefpType
+    size_t digits[3] = {0, 0, 0};    // digit emissions by idneg, idzer, idpos
+    size_t blocks = 0;            // multi-digit emissions
+    size_t blockDigits = 0;       // ... and the digits they emitted
+    size_t refineChecks = 0;      // candidate sign/digit matrices tried
+    size_t refineFailures = 0;    // ... that did not refine
+    size_t filtered = 0;          // signs of sums and determinants decided in floating point
+    size_t exact = 0;             // ... and those computed on the BigInts
+    size_t nodes = 0;             // nodes and thunks allocated through mk
+    size_t shared = 0;            // conses answered by an equal node already built
+    size_t reused = 0;            // tensor arguments whose advance was already known
+    size_t folded = 0;            // nodes of rationals replaced by their value, see efold
+    size_t compactions = 0;       // DigitStream residuals copied out of a full arena
+    size_t cacheRead = 0;         // digits of constants read back from a ConstantCache
+    size_t cacheComputed = 0;     // ... and computed to fill or extend one
+    size_t speculated = 0;        // arguments handed to the pool ahead of time
+    size_t speculationsUsed = 0;  // ... whose result was absorbed
+    size_t scaleCalls = 0;        // scale() invocations
+    size_t scaleReduced = 0;      // ... that found a content > 1
+    size_t scaleBitsSaved = 0;    // sum over entries of bitLength(before) - bitLength(after)
+    int maxCoeffBits = 0;         // longest coefficient scale() has returned
+
+    // arguments absorbed and digits emitted while each Strategy was current,
+    // by Strategy::id.
+    static const int maxStrategies = 8;
+    size_t strategyTerms[maxStrategies] = {};
+    size_t strategyDigits[maxStrategies] = {};
+
+    static Stats &get() {
+        static thread_local Stats s;
+        return s;
+    }
+
+    void reset() { *this = Stats(); }
+};
+
+// gcd of xs[0..n), stopping early once it reaches 1. Starting from the
+// shortest nonzero entry keeps every later gcd a cheap remainder by a
+// small number, and usually hits 1 after one or two steps.
+template<typename T>
+T content(const T *const *xs, int n) {
+    int first = -1;
+    for (int i = 0; i < n; ++i) {
+        if (*xs[i] != 0 && (first < 0 || bitLength(*xs[i]) < bitLength(*xs[first]))) {
+            first = i;
+        }
+    }
+    if (first < 0) { return 0; }
+    T g = abs(*xs[first]);
+    for (int i = 0; i < n && g != 1; ++i) {
+        if (i != first && *xs[i] != 0) {
+            g = gcd(*xs[i] % g, g);
+        }
+    }
+    return g;
+}
+
+// divide *xs[0..n) in place by their content, updating Stats.
+template<typename T>
+void descale(T *const *xs, int n) {
+    Stats &stats = Stats::get();
+    stats.scaleCalls++;
+    const T g = content((const T *const *) xs, n);
+    if (g != 0 && g != 1) {
+        stats.scaleReduced++;
+        for (int i = 0; i < n; ++i) {
+            const int before = bitLength(*xs[i]);
+            *xs[i] = *xs[i] / g;
+            stats.scaleBitsSaved += before - bitLength(*xs[i]);
+        }
+    }
+    for (int i = 0; i < n; ++i) {
+        stats.maxCoeffBits = std::max(stats.maxCoeffBits, bitLength(*xs[i]));
+    }
+}
+
+// coefficient type of every LFT the engine builds.
+using num = BigInt;
+
+template<typename T>
+struct VecT;
+template<typename T>
+struct MatT;
+template<typename T>
+struct TensorT;
+
 struct Expr;
-struct LFT;
 
+struct ExprThunk;
+struct LFT;
 struct OutFile {
 public:
     OutFile(const char *path) { f = fopen(path, "w"); }
@@ -101,224 +754,576 @@ struct ScopedIndenter {
 static OutFile cerr(stderr);
 static OutFile cout(stdout);
 
-void debugPrompt(const char *name) {
-    cerr << "\n" << name << "[press key]>\n";
-    getchar();
-}
-
-enum class LFTType {
-    Vec, Mat, Tensor
-};
-
-struct LFT {
-    const LFTType type;
-
-    LFT(LFTType type) : type(type) {};
-
-    template<typename T>
-    bool isa() const {
-        return type == T::getLFTType();
+// ===Arena allocation===
+// Open addressing map from hashes to (key, value) pointer pairs, for the
+// per-arena node indexes below. Several keys may share a hash, so find()
+// asks the caller to confirm a candidate key. Nothing is ever erased except
+// by clear(), which keeps the slots for reuse.
+struct NodeTable {
+    // the value of the first entry with hash h whose key satisfies match,
+    // or nullptr.
+    template<typename F>
+    const void *find(size_t h, F &&match) const {
+        if (slots.empty()) { return nullptr; }
+        for (size_t i = index(h);; i = (i + 1) & (slots.size() - 1)) {
+            const Slot &s = slots[i];
+            if (!s.key) { return nullptr; }
+            if (s.hash == h && match(s.key)) { return s.value; }
+        }
     }
 
-    template<typename T>
-    const T *cast() const {
-        assert(isa<T>());
-        return (T *) this;
+    void insert(size_t h, const void *key, const void *value) {
+        if (2 * (n + 1) > slots.size()) { grow(); }
+        size_t i = index(h);
+        while (slots[i].key) { i = (i + 1) & (slots.size() - 1); }
+        slots[i] = Slot{h, key, value};
+        n++;
     }
 
-    template<typename T>
-    const T *dyn_cast() const {
-        if (isa<T>()) {
-            return (T *) this;
+    void clear() {
+        if (n > 0) {
+            std::fill(slots.begin(), slots.end(), Slot{0, nullptr, nullptr});
+            n = 0;
         }
-        return nullptr;
     }
 
-    virtual bool refine() const = 0;
-
-    virtual int branch() const = 0;
-
-    // do I need cons? no idea. page 188
-    virtual const Expr *cons(std::function<const Expr *(int)> f) const = 0;
-
-    virtual const Expr *app(std::function<const Expr *(int)> f) const = 0;
+private:
+    struct Slot {
+        size_t hash;
+        const void *key;
+        const void *value;
+    };
 
-    static const LFT *dot(int i, const LFT *a, const LFT *b);
+    // Fibonacci hashing: the top bits of h times 2^64 / phi.
+    size_t index(size_t h) const { return (h * 0x9e3779b97f4a7c15ull) >> (64 - shift); }
 
-};
+    void grow() {
+        std::vector<Slot> old = std::move(slots);
+        shift = old.empty() ? 6 : shift + 1;
+        slots.assign((size_t) 1 << shift, Slot{0, nullptr, nullptr});
+        n = 0;
+        for (const Slot &s : old) {
+            if (s.key) { insert(s.hash, s.key, s.value); }
+        }
+    }
 
-enum class ExprType {
-    Vec = 'v', Mat = 'm', Tensor = 't'
+    std::vector<Slot> slots;
+    size_t n = 0;
+    int shift = 0;  // log2 of slots.size()
 };
 
-struct Expr {
-    const ExprType exprty;
+// Evaluating an expression creates a large number of tiny, short lived nodes:
+// heads, products from LFT::dot, and the conses built by app. Inside an
+// ArenaScope these are bump allocated out of the scope's Arena, and the whole
+// lot is released in one go when the outermost scope on that arena exits.
+// Objects that are not trivially destructible (BigInt limbs, captured
+// std::functions) are registered and destroyed on reset.
+struct Arena {
+    explicit Arena(size_t blockSize = 64 * 1024) : blockSize(blockSize) {};
 
-    Expr(ExprType exprty) : exprty(exprty) {};
+    Arena(const Arena &) = delete;
 
-    virtual const LFT *head() const = 0;
+    Arena &operator=(const Arena &) = delete;
 
-    virtual const Expr *tail(int i) const = 0;
-};
+    ~Arena() {
+        reset();
+        for (char *b : blocks) { free(b); }
+    }
 
+    void *allocate(size_t size, size_t align) {
+        size_t p = (cur + align - 1) & ~(align - 1);
+        if (blockIx >= blocks.size() || p + size > blockSizes[blockIx]) {
+            nextBlock(size + align);
+            p = (cur + align - 1) & ~(align - 1);
+        }
+        cur = p + size;
+        nbytes += size;
+        nallocs++;
+        return blocks[blockIx] + p;
+    }
 
-struct Vec : public LFT, public Expr {
-    int v0, v1;
+    template<typename T, typename... Args>
+    T *make(Args &&... args) {
+        T *t = new(allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        if (!std::is_trivially_destructible<T>::value) {
+            finalizers.push_back({t, [](void *p) { static_cast<T *>(p)->~T(); }});
+        }
+        return t;
+    }
 
-    Vec(int v0, int v1) : v0(v0), v1(v1), LFT(LFTType::Vec), Expr(ExprType::Vec) {};
+    // destroy everything allocated so far, in this arena and its children.
+    // The blocks are kept for reuse, so a long lived process settles at its
+    // high water mark.
+    void reset() {
+        for (size_t i = 0; i < nchildren; ++i) { children[i]->reset(); }
+        nchildren = 0;
+        for (size_t i = finalizers.size(); i-- > 0;) {
+            finalizers[i].second(finalizers[i].first);
+        }
+        finalizers.clear();
+        interned.clear();
+        advanced.clear();
+        blockIx = 0;
+        cur = 0;
+        nbytes = 0;
+        nallocs = 0;
+    }
 
-    int dot(Vec v) { return v0 * v.v0 + v1 * v.v1; }
+    // in this arena alone.
+    size_t bytesAllocated() const { return nbytes; }
 
-    static LFTType getLFTType() { return LFTType::Vec; }
+    // in this arena and the children in use.
+    size_t bytesInUse() const {
+        size_t out = nbytes;
+        for (size_t i = 0; i < nchildren; ++i) { out += children[i]->bytesInUse(); }
+        return out;
+    }
 
-    // sign() = clamp(-1, sgn(v0) + sgn(v1), 1)
-    int sign() const {
-        if (v0 < 0) {
-            return v1 <= 0 ? -1 : 0;
-        } else if (v0 == 0) {
-            if (v1 < 0) {
-                return -1;
-            } else if (v1 == 0) {
-                return 0;
-            } else {
-                assert(v1 > 0);
-                return 1;
-            }
-        } else {
-            assert(v0 > 0);
-            return v1 >= 0 ? 1 : 0;
+    // whether p was allocated in this arena or one of its children since the
+    // last reset.
+    bool owns(const void *p) const {
+        const char *c = static_cast<const char *>(p);
+        for (size_t i = 0; i < blocks.size() && i <= blockIx; ++i) {
+            if (c >= blocks[i] && c < blocks[i] + blockSizes[i]) { return true; }
         }
+        for (size_t i = 0; i < nchildren; ++i) {
+            if (children[i]->owns(p)) { return true; }
+        }
+        return false;
     }
 
-    Vec scale() const {
-        if (v0 % 2 == 0 && v1 % 2 == 0) {
-            return Vec(v0 / 2, v1 / 2);
-        }
-        return *this;
+    size_t allocations() const { return nallocs; }
+
+    // keep everything allocated alive until the matching release(), across
+    // however many scopes open and close in between.
+    void retain() { depth++; }
+
+    void release() {
+        assert(depth > 0);
+        if (--depth == 0) { reset(); }
     }
 
-    bool refine() const override {
-        // TODO: does ~= mean != ?
-        return sign() != 0;
+    // a fresh arena whose contents live exactly as long as this one's, for
+    // another thread to allocate in on this arena's behalf. Like everything
+    // else on an arena, only the thread using it may call this.
+    Arena &child() {
+        if (nchildren == children.size()) {
+            children.push_back(std::unique_ptr<Arena>(new Arena(4096)));
+            children.back()->retain();
+        }
+        return *children[nchildren++];
     }
 
-    int branch() const override { return 0; }
+    // nodes built in this arena, by head and arguments (see LFT::cons), and
+    // the one digit dem of tensor arguments run() has computed here (see
+    // advanced()). Both only refer to nodes that live at least as long as the
+    // arena.
+    NodeTable interned;
+    NodeTable advanced;
 
-    const Expr *app(std::function<const Expr *(int)> f) const override {
-        assert(false && "unimplemented for this class");
-        return nullptr;
+    size_t bytesReserved() const {
+        size_t out = 0;
+        for (size_t s : blockSizes) { out += s; }
+        return out;
     }
 
-    const Expr *cons(std::function<const Expr *(int)> f) const override {
-        return new Vec(*this);
+    // arena that new nodes on this thread go to, or nullptr for the heap.
+    static Arena *&current() {
+        static thread_local Arena *a = nullptr;
+        return a;
     }
 
-    const LFT *head() const override {
-        return new Vec(*this);
+    // per-thread arena used by eshow and friends.
+    static Arena &evaluation() {
+        static thread_local Arena a;
+        return a;
     }
 
-    const Expr *tail(int i) const override {
-        assert(false && "vec has no tail!");
-        exit(1);
+private:
+    void nextBlock(size_t atLeast) {
+        if (blocks.size() > 0) { blockIx++; }
+        while (blockIx < blocks.size() && blockSizes[blockIx] < atLeast) { blockIx++; }
+        if (blockIx >= blocks.size()) {
+            const size_t sz = std::max(blockSize, atLeast);
+            char *block = (char *) malloc(sz);
+            if (!block) {
+                throw std::bad_alloc();
+            }
+            blocks.push_back(block);
+            blockSizes.push_back(sz);
+            blockIx = blocks.size() - 1;
+        }
+        cur = 0;
     }
 
+    const size_t blockSize;
+    std::vector<char *> blocks;
+    std::vector<size_t> blockSizes;
+    size_t blockIx = 0;
+    size_t cur = 0;
+    size_t nbytes = 0;
+    size_t nallocs = 0;
+    int depth = 0;
+    std::vector<std::pair<void *, void (*)(void *)>> finalizers;
+    std::vector<std::unique_ptr<Arena>> children;
+    size_t nchildren = 0;  // children in use since the last reset
+};
 
-    bool operator<(const Vec &other) const;
+// routes node allocation on this thread to `arena` (nullptr = the heap)
+// for the lifetime of the scope. Leaving the outermost scope of an arena
+// resets it unless the arena is retained, so nothing allocated inside may
+// escape.
+struct ArenaScope {
+    explicit ArenaScope(Arena *arena) : arena(arena), prev(Arena::current()) {
+        Arena::current() = arena;
+        if (arena) { arena->retain(); }
+    }
 
+    explicit ArenaScope(Arena &arena) : ArenaScope(&arena) {};
 
-    void print(OutFile &o) const {
-        o << "v(" << v0 << " " << v1 << ")";
+    ~ArenaScope() {
+        Arena::current() = prev;
+        if (arena) { arena->release(); }
     }
+
+    Arena *const arena;
+    Arena *const prev;
 };
 
-OutFile &operator<<(OutFile &o, Vec v) {
-    v.print(o);
-    return o;
+// allocate an expression or LFT node in the current arena.
+template<typename T, typename... Args>
+T *mk(Args &&... args) {
+    Stats::get().nodes++;
+    if (Arena *a = Arena::current()) {
+        return a->make<T>(std::forward<Args>(args)...);
+    }
+    return new T(std::forward<Args>(args)...);
 }
 
+// ===Parallel evaluation===
+// A small work-stealing scheduler. Every worker owns a deque: it pushes and
+// pops its own tasks at the back and steals from the front of the others'.
+// Threads outside the pool submit to a shared deque of their own. A thread
+// that waits for a task runs other tasks in the meantime, so tasks may wait
+// on tasks they spawned without deadlocking the pool. run() uses it to
+// advance the other argument of a tensor while it works on one (see
+// Speculation).
+struct Pool {
+    struct Task {
+        std::function<void()> fn;
+        std::atomic<bool> done{false};
+    };
 
-struct Mat : public LFT {
-    const int mat[2][2];
-
-    //   coordinates: (row, col)
-    //     |col      col
-    //-----+------------------
-    // row |a:(0, 0) b:(0, 1)
-    // row |c:(1, 0) d:(1, 1)
-    int a() const { return mat[0][0]; }
+    explicit Pool(int nthreads = (int) std::max(1u, std::thread::hardware_concurrency())) {
+        for (int i = 0; i <= nthreads; ++i) {
+            queues.push_back(std::unique_ptr<Queue>(new Queue()));
+        }
+        for (int i = 0; i < nthreads; ++i) {
+            threads.emplace_back([this, i]() { work(i); });
+        }
+    }
 
-    int b() const { return mat[0][1]; }
+    Pool(const Pool &) = delete;
 
-    int c() const { return mat[1][0]; }
+    Pool &operator=(const Pool &) = delete;
 
-    int d() const { return mat[1][1]; }
+    ~Pool() {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        sleepCv.notify_all();
+        for (std::thread &t : threads) { t.join(); }
+    }
 
-    Vec v0() const { return Vec(a(), b()); }
+    int size() const { return (int) threads.size(); }
 
-    Vec v1() const { return Vec(c(), d()); }
+    // tasks submitted but not yet started.
+    size_t pending() const { return npending.load(std::memory_order_relaxed); }
 
-    Mat(int a, int b, int c, int d) : mat{{a, b},
-                                          {c, d}}, LFT(LFTType::Mat) {}
+    void submit(std::shared_ptr<Task> t) {
+        Queue &q = *queues[self() < 0 ? threads.size() : self()];
+        {
+            std::lock_guard<std::mutex> lock(q.mutex);
+            q.tasks.push_back(std::move(t));
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            npending++;
+        }
+        sleepCv.notify_one();
+    }
 
-    Mat(Vec v, Vec w) : mat{v.v0, v.v1, w.v0, w.v1}, LFT(LFTType::Mat) {}
+    // block until t has run, running other tasks meanwhile.
+    void wait(const Task &t) {
+        while (!t.done.load(std::memory_order_acquire)) {
+            if (!runOne()) { std::this_thread::yield(); }
+        }
+    }
 
-    static LFTType getLFTType() { return LFTType::Mat; }
+    // pool that evaluations on this thread hand work to, or nullptr to
+    // evaluate sequentially. Workers use their own pool.
+    static Pool *&current() {
+        static thread_local Pool *p = nullptr;
+        return p;
+    }
 
-    static Mat identity() { return Mat(1, 0, 0, 1); }
+    // tasks running on this thread, each inside the wait() of the one
+    // before. A task that submits nothing never waits, so declining to
+    // submit past some nesting keeps the stack bounded.
+    static int nesting() { return depth; }
 
-    Mat transpose() const { return Mat(a(), c(), b(), d()); }
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::shared_ptr<Task>> tasks;
+    };
+
+    // index of this thread's deque in this pool, or -1 if it is not a worker.
+    int self() const { return workerOf == this ? workerIndex : -1; }
+
+    // take the newest task from our own deque or the oldest from another.
+    std::shared_ptr<Task> take() {
+        const int me = self(), n = (int) queues.size();
+        for (int k = 0; k < n; ++k) {
+            const int i = me < 0 ? k : (me + k) % n;
+            Queue &q = *queues[i];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            if (!q.tasks.empty()) {
+                std::shared_ptr<Task> t;
+                if (i == me) {
+                    t = std::move(q.tasks.back());
+                    q.tasks.pop_back();
+                } else {
+                    t = std::move(q.tasks.front());
+                    q.tasks.pop_front();
+                }
+                npending--;
+                return t;
+            }
+        }
+        return nullptr;
+    }
 
-    int determinant() const { return a() * d() - b() * c(); }
+    bool runOne() {
+        std::shared_ptr<Task> t = take();
+        if (!t) { return false; }
+        depth++;
+        t->fn();
+        depth--;
+        t->done.store(true, std::memory_order_release);
+        return true;
+    }
 
-    // tame inverse
-    Mat inverse() const { return Mat(d(), -b(), -c(), a()); }
+    void work(int i) {
+        workerOf = this;
+        workerIndex = i;
+        current() = this;
+        for (int idle = 0;; ++idle) {
+            if (runOne()) {
+                idle = 0;
+                continue;
+            }
+            // tasks are short and come in bursts: spin a while before
+            // paying for a sleep and a wakeup.
+            if (idle < spinLimit) {
+                std::this_thread::yield();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            sleepCv.wait(lock, [this]() { return stopping || npending > 0; });
+            if (stopping) { return; }
+        }
+    }
+
+    static const int spinLimit = 4096;
+
+    static thread_local const Pool *workerOf;
+    static thread_local int workerIndex;
+    static thread_local int depth;
+
+    std::vector<std::unique_ptr<Queue>> queues;  // one per worker, then one for other threads
+    std::vector<std::thread> threads;
+    std::atomic<size_t> npending{0};
+    std::mutex sleepMutex;
+    std::condition_variable sleepCv;
+    bool stopping = false;
+};
+
+thread_local const Pool *Pool::workerOf = nullptr;
+thread_local int Pool::workerIndex = -1;
+thread_local int Pool::depth = 0;
+
+// evaluations on this thread use `pool` (nullptr = none) for the lifetime
+// of the scope.
+struct PoolScope {
+    explicit PoolScope(Pool *pool) : prev(Pool::current()) { Pool::current() = pool; }
+
+    ~PoolScope() { Pool::current() = prev; }
 
-    // scaling by 2
-    Mat scale() const {
-        if (a() % 2 == 0 && b() % 2 == 0 && c() % 2 == 0 && d() % 2 == 0) {
-            return Mat(a() / 2, b() / 2, c() / 2, d() / 2);
+    Pool *const prev;
+};
+
+
+OutFile &operator<<(OutFile &f, const BigInt &b) {
+    f.write(b.str());
+    return f;
+}
+
+const char *strategyName(int id);
+
+OutFile &operator<<(OutFile &f, const Stats &s) {
+    f << "absorbed " << (ll) s.absorbed[0] << "/" << (ll) s.absorbed[1]
+      << " declined " << (ll) s.declined[0] << "/" << (ll) s.declined[1]
+      << " signs +" << (ll) s.signs[0] << " -" << (ll) s.signs[1]
+      << " inf " << (ll) s.signs[2] << " zer " << (ll) s.signs[3]
+      << " digits " << (ll) s.digits[0] << "/" << (ll) s.digits[1] << "/" << (ll) s.digits[2]
+      << " blocks " << (ll) s.blocks << " (" << (ll) s.blockDigits << " digits)"
+      << " refine " << (ll) (s.refineChecks - s.refineFailures) << "/" << (ll) s.refineChecks
+      << " filtered " << (ll) s.filtered << "/" << (ll) (s.filtered + s.exact)
+      << " nodes " << (ll) s.nodes
+      << " shared " << (ll) s.shared << " reused " << (ll) s.reused << " folded " << (ll) s.folded
+      << " compactions " << (ll) s.compactions
+      << " cache " << (ll) s.cacheRead << "/" << (ll) (s.cacheRead + s.cacheComputed)
+      << " speculated " << (ll) s.speculationsUsed << "/" << (ll) s.speculated
+      << " scaled " << (ll) s.scaleReduced << "/" << (ll) s.scaleCalls << " (" << (ll) s.scaleBitsSaved << " bits)"
+      << " max bits " << s.maxCoeffBits;
+    for (int i = 0; i < Stats::maxStrategies; ++i) {
+        if (s.strategyTerms[i] > 0) {
+            f << " " << strategyName(i) << " " << (ll) s.strategyDigits[i] << "/" << (ll) s.strategyTerms[i];
         }
-        return *this;
+    }
+    return f;
+}
+
+// ===LFT arithmetic===
+// VecT, MatT and TensorT hold the coefficients and implement the products,
+// generic over the coefficient type T. They are plain values: the engine
+// instantiates them with `num` as Vec, Mat and Tensor, and LFT below is the
+// closed sum of the three.
+
+template<typename T>
+struct VecT {
+    T v0, v1;
+
+    VecT(T v0, T v1) : v0(v0), v1(v1) {};
+
+    T dot(VecT v) const { return v0 * v.v0 + v1 * v.v1; }
+
+    // sign() = clamp(-1, sgn(v0) + sgn(v1), 1)
+    int sign() const {
+        const int s = sgn(v0) + sgn(v1);
+        return s < -1 ? -1 : (s > 1 ? 1 : s);
+    }
+
+    VecT scale() const {
+        VecT out = *this;
+        T *xs[] = {&out.v0, &out.v1};
+        descale(xs, 2);
+        return out;
+    }
+
+    bool refine() const {
+        // TODO: does ~= mean != ?
+        return sign() != 0;
+    }
+
+    bool operator<(const VecT &other) const;
+
+    bool operator==(const VecT &other) const { return v0 == other.v0 && v1 == other.v1; }
+
+    size_t hash() const { return hashMix(hashValue(v0), hashValue(v1)); }
+
+    void print(OutFile &o) const {
+        o << "v(" << v0 << " " << v1 << ")";
+    }
+};
+
+template<typename T>
+OutFile &operator<<(OutFile &o, const VecT<T> &v) {
+    v.print(o);
+    return o;
+}
+
+
+template<typename T>
+struct MatT {
+    T mat[2][2];
+
+    //   coordinates: (row, col)
+    //     |col      col
+    //-----+------------------
+    // row |a:(0, 0) b:(0, 1)
+    // row |c:(1, 0) d:(1, 1)
+    T a() const { return mat[0][0]; }
+
+    T b() const { return mat[0][1]; }
+
+    T c() const { return mat[1][0]; }
+
+    T d() const { return mat[1][1]; }
+
+    VecT<T> v0() const { return VecT<T>(a(), b()); }
+
+    VecT<T> v1() const { return VecT<T>(c(), d()); }
+
+    MatT(T a, T b, T c, T d) : mat{{a, b},
+                                   {c, d}} {}
+
+    MatT(VecT<T> v, VecT<T> w) : mat{{v.v0, v.v1},
+                                     {w.v0, w.v1}} {}
+
+    static MatT identity() { return MatT(1, 0, 0, 1); }
+
+    MatT transpose() const { return MatT(a(), c(), b(), d()); }
+
+    T determinant() const { return a() * d() - b() * c(); }
+
+    // tame inverse
+    MatT inverse() const { return MatT(d(), -b(), -c(), a()); }
+
+    // divide out the content
+    MatT scale() const {
+        MatT out = *this;
+        T *xs[] = {&out.mat[0][0], &out.mat[0][1], &out.mat[1][0], &out.mat[1][1]};
+        descale(xs, 4);
+        return out;
     }
 
     // it's all row vector based.
     // [v0 v1] [m00 m01]  = [v0m00 + v1m10; v0m01 + v1m11]
     //         [m10 m11]
-    Vec dot(const Vec &v) const {
-        return Vec(mat[0][0] * v.v0 + mat[1][0] * v.v1, mat[0][1] * v.v0 + mat[1][1] * v.v1);
+    VecT<T> dot(const VecT<T> &v) const {
+        return VecT<T>(mat[0][0] * v.v0 + mat[1][0] * v.v1, mat[0][1] * v.v0 + mat[1][1] * v.v1);
     }
 
     // [[t00 t01]] [[m00 m01]] =
     // [t10 t11]]  [[m10 m11]]
     // [[t00 t01] [t10 t11]] @ [m00 m01]; [[t00 t01] [t10 t11]] @ [m10 m11]]
-    Mat dot(const Mat &m) const {
-        return Mat(this->dot(m.v0()), this->dot(m.v1()));
+    MatT dot(const MatT &m) const {
+        return MatT(this->dot(m.v0()), this->dot(m.v1()));
     }
 
-    Tensor dot(const Tensor &t) const;
+    TensorT<T> dot(const TensorT<T> &t) const;
 
-    bool refine() const override {
+    bool refine() const {
         const int a = v0().sign(), b = v1().sign();
         return a == b && b != 0;
     }
 
-    int branch() const override { return 1; }
-
-    const Expr *app(std::function<const Expr *(int)> g) const override;
-
-    bool operator<(const Vec &x) const {
+    bool operator<(const VecT<T> &x) const {
         return (this->v0() < x) && (this->v1() < x);
     }
 
-    bool operator<(const Mat &m) const {
+    bool operator<(const MatT &m) const {
         return (*this < m.v0()) && (*this < m.v1());
     }
 
-    static bool disjoint(const Mat &m, const Mat &n) {
+    static bool disjoint(const MatT &m, const MatT &n) {
         return (m < n) || (n < m);
     }
 
-    bool operator==(const Mat &other) const {
+    bool operator==(const MatT &other) const {
         for (int i = 0; i < 2; ++i) {
             for (int j = 0; j < 2; ++j) {
                 if (mat[i][j] != other.mat[i][j]) {
@@ -329,58 +1334,63 @@ struct Mat : public LFT {
         return true;
     }
 
-    const Expr *cons(std::function<const Expr *(int)> f) const override;
+    size_t hash() const { return hashMix(v0().hash(), v1().hash()); }
 
     void print(OutFile &o) const {
         o << "m(" << v0() << " " << v1() << ")";
     }
 };
 
-OutFile &operator<<(OutFile &o, Mat m) {
+template<typename T>
+OutFile &operator<<(OutFile &o, const MatT<T> &m) {
     m.print(o);
     return o;
 }
 
-bool Vec::operator<(const Vec &other) const {
-    return Mat(*this, other).determinant() < 0;
+// sgn(v0 w1 - v1 w0), the orientation of v and w.
+template<typename T>
+int detSign(const VecT<T> &v, const VecT<T> &w) {
+    return sgn(MatT<T>(v, w).determinant());
 }
 
+int detSign(const VecT<BigInt> &v, const VecT<BigInt> &w) {
+    Stats &stats = Stats::get();
+#if FRACTIONS_FILTER
+    // scaling v and w by positive factors leaves the sign alone.
+    const int sv = std::max(bitLength(v.v0), bitLength(v.v1));
+    const int sw = std::max(bitLength(w.v0), bitLength(w.v1));
+    const double ad = v.v0.scaled(sv) * w.v1.scaled(sw);
+    const double bc = v.v1.scaled(sv) * w.v0.scaled(sw);
+    const int s = filteredSign(ad - bc, __builtin_fabs(ad) + __builtin_fabs(bc));
+    if (s != Undecided) {
+        stats.filtered++;
+        return s;
+    }
+#endif
+    stats.exact++;
+    return sgn(v.v0 * w.v1 - v.v1 * w.v0);
+}
 
-const Mat spos(1, 0, 0, 1);
-const Mat sinf(1, -1, 1, 1);
-const Mat sneg(0, 1, -1, 0);
-const Mat szer(1, 1, -1, 1);
-
-const Mat ispos(spos.inverse());
-const Mat isinf(sinf.inverse());
-const Mat isneg(sneg.inverse());
-const Mat iszer(szer.inverse());
-
-// see section 9.1
-const Mat dneg(1, 1, 0, 2);
-const Mat dzer(3, 1, 1, 3);
-const Mat dpos(2, 0, 1, 1);
-
-const Mat idneg(dneg.inverse());
-const Mat idzer(dzer.inverse());
-const Mat idpos(dpos.inverse());
-
-struct Tensor : public LFT {
-    const Mat ms[2];
-    const int n = 0;  // for absorption
+template<typename T>
+bool VecT<T>::operator<(const VecT &other) const {
+    return detSign(*this, other) < 0;
+}
 
-    Tensor(Mat m0, Mat m1, int n = 0)
-            : ms{m0, m1}, LFT(LFTType::Tensor), n(n) {};
+template<typename T>
+struct TensorT {
+    MatT<T> ms[2];
+    int n = 0;  // for absorption
 
-    Tensor bumpn() const { return Tensor(ms[0], ms[1], n + 1); }
+    TensorT(MatT<T> m0, MatT<T> m1, int n = 0)
+            : ms{m0, m1}, n(n) {};
 
-    static LFTType getLFTType() { return LFTType::Tensor; }
+    TensorT bumpn() const { return TensorT(ms[0], ms[1], n + 1); }
 
-    Mat m0() const { return ms[0]; }
+    MatT<T> m0() const { return ms[0]; }
 
-    Mat m1() const { return ms[1]; }
+    MatT<T> m1() const { return ms[1]; }
 
-    Tensor inverse() const {
+    TensorT inverse() const {
         for (int i = 0; i < 2; ++i) {
             for (int j = 0; j < 2; ++j) {
                 for (int k = 0; k < 2; ++k) {
@@ -390,602 +1400,3639 @@ struct Tensor : public LFT {
                 }
             }
         }
-        return Tensor(ms[0].scale(), ms[1].scale());
+        return TensorT(ms[0].scale(), ms[1].scale());
     }
 
-    Tensor transpose() const {
-        Vec v00 = m0().v0();
-        Vec v01 = m0().v1();
-        Vec v10 = m1().v0();
-        Vec v11 = m1().v1();
-        return Tensor({v00, v10}, {v01, v11});
+    TensorT transpose() const {
+        VecT<T> v00 = m0().v0();
+        VecT<T> v01 = m0().v1();
+        VecT<T> v10 = m1().v0();
+        VecT<T> v11 = m1().v1();
+        return TensorT(MatT<T>(v00, v10), MatT<T>(v01, v11), n);
     }
 
     // tensor products: tleftv, tleftm, trightv, trightm
-    Mat left(Vec v) const { return transpose().right(v); }
+    MatT<T> left(VecT<T> v) const { return transpose().right(v); }
 
-    Mat right(Vec v) const { return Mat(m0().dot(v), m1().dot(v)); }
+    MatT<T> right(VecT<T> v) const { return MatT<T>(m0().dot(v), m1().dot(v)); }
 
-    Tensor left(Mat m) const { return (transpose().right(m)).transpose(); }
+    TensorT left(MatT<T> m) const { return (transpose().right(m)).transpose(); }
 
-    Tensor right(Mat m) const { return Tensor(m0().dot(m), m1().dot(m)); }
+    TensorT right(MatT<T> m) const { return TensorT(m0().dot(m), m1().dot(m), n); }
 
-    bool refine() const override {
-        const Vec v = m0().v0();
-        const Vec w = m0().v1();
-        const Vec x = m1().v0();
-        const Vec y = m1().v1();
+    bool refine() const {
+        const VecT<T> v = m0().v0();
+        const VecT<T> w = m0().v1();
+        const VecT<T> x = m1().v0();
+        const VecT<T> y = m1().v1();
         const int a = v.sign(), b = w.sign(), c = x.sign(), d = y.sign();
         return a == b && b == c && c == d && d != 0;
     }
 
-    int branch() const override { return 2; }
-
-    const Expr *app(std::function<const Expr *(int)> g) const override;
-
-    Tensor scale() const {
+    TensorT scale() const {
+        TensorT out = *this;
+        T *xs[8];
         for (int i = 0; i < 2; ++i) {
             for (int j = 0; j < 2; ++j) {
                 for (int k = 0; k < 2; ++k) {
-                    if (ms[i].mat[j][k] % 2 != 0) {
-                        return *this;
-                    }
+                    xs[4 * i + 2 * j + k] = &out.ms[i].mat[j][k];
                 }
             }
         }
-        return Tensor(m0().scale(), m1().scale());
+        descale(xs, 8);
+        return out;
+    }
+
+    // n is part of the value: it steers which side is absorbed next.
+    bool operator==(const TensorT &other) const {
+        return n == other.n && ms[0] == other.ms[0] && ms[1] == other.ms[1];
     }
 
-    const Expr *cons(std::function<const Expr *(int)> f) const override;
+    size_t hash() const { return hashMix(hashMix(ms[0].hash(), ms[1].hash()), n); }
 
     void print(OutFile &o) const {
         o << "t(" << m0() << " " << m1() << ")";
     }
 };
 
-OutFile &operator<<(OutFile &o, Tensor t) {
+template<typename T>
+OutFile &operator<<(OutFile &o, const TensorT<T> &t) {
     t.print(o);
     return o;
 }
 
-
-Tensor Mat::dot(const Tensor &t) const {
-    return Tensor(this->dot(t.m0()), this->dot(t.m1()));
+template<typename T>
+TensorT<T> MatT<T>::dot(const TensorT<T> &t) const {
+    return TensorT<T>(this->dot(t.m0()), this->dot(t.m1()), t.n);
 };
 
+
+using Vec = VecT<num>;
+using Mat = MatT<num>;
+using Tensor = TensorT<num>;
+
+const Mat spos(1, 0, 0, 1);
+const Mat sinf(1, -1, 1, 1);
+const Mat sneg(0, 1, -1, 0);
+const Mat szer(1, 1, -1, 1);
+
+const Mat ispos(spos.inverse());
+const Mat isinf(sinf.inverse());
+const Mat isneg(sneg.inverse());
+const Mat iszer(szer.inverse());
+
+// see section 9.1
+const Mat dneg(1, 1, 0, 2);
+const Mat dzer(3, 1, 1, 3);
+const Mat dpos(2, 0, 1, 1);
+
+const Mat idneg(dneg.inverse());
+const Mat idzer(dzer.inverse());
+const Mat idpos(dpos.inverse());
+
 const Tensor tadd(Mat(0, 0, 1, 0), Mat(1, 0, 0, 1));
 const Tensor tsub(Mat(0, 0, 1, 0), Mat(-1, 0, 0, 1));
 const Tensor tmul(Mat(1, 0, 0, 0), Mat(0, 0, 0, 1));
 const Tensor tdiv(Mat(0, 0, 1, 0), Mat(0, 1, 0, 0));
 
+// ===LFTs===
 
-OutFile &operator<<(OutFile &o, const LFT &lft) {
-    if (lft.isa<Vec>()) {
-        lft.cast<Vec>()->print(o);
-    } else if (lft.isa<Mat>()) {
-        lft.cast<Mat>()->print(o);
-    } else {
-        assert(lft.isa<Tensor>());
-        lft.cast<Tensor>()->print(o);
-    }
-    return o;
-}
+enum class LFTType {
+    Vec, Mat, Tensor
+};
 
-OutFile &operator<<(OutFile &o, const Expr &e) {
-    return o << "Expr(" << (char) e.exprty << " " << (void *) e.head() << " = " << *e.head() << ")";
-}
+// An LFT is exactly one of Vec, Mat or Tensor, held by value. Everything
+// that depends on which one it is goes through isa/cast or visit, so the
+// products below are chosen at compile time per (left, right) pair.
+struct LFT {
+    LFT(Vec v) : lft(std::move(v)) {};
 
+    LFT(Mat m) : lft(std::move(m)) {};
 
-struct ExprThunk {
-    ExprThunk(std::function<const Expr *()> thunk) : thunk(thunk) {};
+    LFT(Tensor t) : lft(std::move(t)) {};
 
-    const Expr *get() const {
-        if (!value) {
-            value = thunk();
-        }
-        return value;
+    // the variant alternatives are in LFTType order.
+    LFTType type() const { return (LFTType) lft.index(); }
+
+    template<typename T>
+    bool isa() const {
+        return std::holds_alternative<T>(lft);
     }
 
-    static ExprThunk thunkify(const Expr *e) {
-        return ExprThunk([e]() { return e; });
+    template<typename T>
+    const T &cast() const {
+        assert(isa<T>());
+        return *std::get_if<T>(&lft);
     }
 
-private:
-    std::function<const Expr *()> thunk;
-    mutable const Expr *value = nullptr;
-};
+    template<typename T>
+    const T *dyn_cast() const {
+        return std::get_if<T>(&lft);
+    }
 
-struct MatExpr : public Expr {
-    const Mat m;
-    const ExprThunk ethunk;
+    template<typename F>
+    auto visit(F &&f) const {
+        return std::visit(std::forward<F>(f), lft);
+    }
 
-    // const Expr *e;
-    MatExpr(Mat m, ExprThunk ethunk) : m(m), ethunk(ethunk), Expr(ExprType::Mat) {}
+    bool refine() const {
+        return visit([](const auto &x) { return x.refine(); });
+    }
 
-    const LFT *head() const override { return new Mat(m); }
+    bool operator==(const LFT &other) const { return lft == other.lft; }
 
-    const Expr *tail(int i) const override {
-        assert(i == 1);
-        return ethunk.get();
+    size_t hash() const {
+        return hashMix((size_t) type(), visit([](const auto &x) { return x.hash(); }));
     }
-};
 
-const Expr *Mat::cons(std::function<const Expr *(int)> f) const {
-    return new MatExpr(*this, ExprThunk([f]() { return f(1); }));
-}
+    // number of arguments: 0 for a vector, 1 for a matrix, 2 for a tensor.
+    int branch() const { return (int) type(); }
 
-// counter for each tensor, fair absorption (section 11.6)
-struct TensorExpr : public Expr {
-    Tensor t;
-    int counter;
-    const ExprThunk lthunk;
-    const ExprThunk rthunk;
+    // page 188
+    const Expr *cons(const ExprThunk *const *ts) const;
 
-    TensorExpr(Tensor t, int counter, const ExprThunk lthunk,
-               const ExprThunk rthunk)
-            : Expr(ExprType::Tensor), t(t), counter(counter), lthunk(lthunk), rthunk(rthunk) {};
+    // absorb args[0..branch) into this lft.
+    const Expr *app(const Expr *const *args) const;
 
-    const LFT *head() const override { return new Tensor(t); }
+    static LFT dot(int i, const LFT &l, const LFT &r);
 
-    const Expr *tail(int i) const override {
-        assert(i == 1 || i == 2);
-        return i == 1 ? lthunk.get() : rthunk.get();
-    }
+private:
+    std::variant<Vec, Mat, Tensor> lft;
 };
 
-const Expr *Tensor::cons(std::function<const Expr *(int)> f) const {
-    return new TensorExpr(*this, this->n,
-                          ExprThunk([f]() { return f(1); }),
-                          ExprThunk([f]() { return f(2); }));
+OutFile &operator<<(OutFile &o, const LFT &lft) {
+    lft.visit([&o](const auto &x) { x.print(o); });
+    return o;
 }
 
+// ===Tracing===
+// Compiled out unless built with -DFRACTIONS_TRACE=1, which records every
+// step of run() in a per-thread ring buffer of fixed size binary records that
+// Trace::dump writes out for offline analysis. FRACTIONS_TRACE=2 also logs
+// the steps as text on stderr.
+#ifndef FRACTIONS_TRACE
+#define FRACTIONS_TRACE 0
+#endif
+
+enum class TraceEvent : uint8_t {
+    Sign, Digit, Absorb, Decline, Push, Pop, App
+};
 
-// Page 185
-const LFT *LFT::dot(int i, const LFT *l, const LFT *r) {
-    assert(i == 1 || i == 2);
-    if (i == 1) {
-        assert(l->isa<Mat>() || l->isa<Tensor>());
-
-        if (l->isa<Mat>()) {
-            const Mat *m = l->cast<Mat>();
-            if (r->isa<Vec>()) {
-                const Vec *v = r->cast<Vec>();
-                return new Vec(m->dot(*v).scale());
-            } else if (r->isa<Mat>()) {
-                const Mat *n = r->cast<Mat>();
-                return new Mat(m->dot(*n).scale());
-            } else {
-                assert(r->isa<Tensor>());
-                const Tensor *t = r->cast<Tensor>();
-                return new Tensor(m->dot(*t).scale());
-            }
-        } else {
-            assert(l->isa<Tensor>());
-            const Tensor *t = l->cast<Tensor>();
-            assert(r->isa<Vec>() || r->isa<Mat>());
-            if (r->isa<Vec>()) {
-                const Vec *v = r->cast<Vec>();
-                return new Mat(t->left(*v).scale());
-            } else {
-                assert(r->isa<Mat>());
-                const Mat *m = r->cast<Mat>();
-                if (*m == Mat::identity()) {
-                    return t;
-                } else {
-                    return new Tensor(t->left(*m).scale().bumpn());
-                }
-            }
-        };
-    } else {
-        assert(i == 2);
-        assert(l->isa<Tensor>());
-        const Tensor *t = l->cast<Tensor>();
-
-        // same as previous code, just left switched to right
-        assert(r->isa<Vec>() || r->isa<Mat>());
-        if (r->isa<Vec>()) {
-            const Vec *v = r->cast<Vec>();
-            return new Mat(t->right(*v).scale());
-        } else {
-            assert(r->isa<Mat>());
-            const Mat *m = r->cast<Mat>();
-            if (*m == Mat::identity()) {
-                return t;
-            } else {
-                return new Tensor(t->right(*m).scale().bumpn());
-            }
-        }
-    }
-}
+struct TraceRecord {
+    uint64_t seq;
+    uint8_t event;   // TraceEvent
+    int8_t arg;      // the sign, digit or argument index
+    uint16_t depth;  // depth of the work stack
+    uint32_t bits;   // longest coefficient of the head after the step
+};
 
-const Expr *Mat::app(std::function<const Expr *(int)> g) const {
-    const LFT *l = this;
-    const LFT *r = g(1)->head();
-    const LFT *lr = LFT::dot(1, l, r);
-    return LFT::dot(1, this, g(1)->head())->cons([g](int i) {
-        return g(1)->tail(i);
-    });
-}
+struct Trace {
+    static const size_t capacity = 1 << 16;
 
-const Expr *Tensor::app(std::function<const Expr *(int)> g) const {
-    ScopedIndenter indent(cerr, __PRETTY_FUNCTION__);
-    cerr << "- g(1): " << *g(1) << "\n";
-    cerr << "- g(2): " << *g(2) << "\n";
+    void record(TraceEvent ev, int arg, size_t depth, int bits) {
+        if (ring.empty()) { ring.resize(capacity); }
+        ring[seq % capacity] = TraceRecord{seq, (uint8_t) ev, (int8_t) arg, (uint16_t) depth, (uint32_t) bits};
+        seq++;
+    }
 
-    const int c = g(1)->head()->branch();
-    cerr << "- c " << c << "\n";
-    const auto h = [g, c](int i) {
-        if (i <= c) {
-            return g(1)->tail(i);
-        } else {
-            return g(2)->tail(i - c);
+    // write the records still in the ring, oldest first.
+    bool dump(const char *path) const {
+        FILE *f = fopen(path, "wb");
+        if (!f) { return false; }
+        for (uint64_t i = seq < capacity ? 0 : seq - capacity; i < seq; ++i) {
+            fwrite(&ring[i % capacity], sizeof(TraceRecord), 1, f);
         }
-    };
-    const LFT *dotTwo = LFT::dot(2, this, g(2)->head());
-    cerr << "- dotTwo " << *dotTwo << "\n";
-    const LFT *dotOne = LFT::dot(1, dotTwo, g(1)->head());
-    cerr << "- dotOne " << *dotOne << "\n";
-    cerr << "- dotOne->cons(h) " << *dotOne->cons(h) << "\n";
-    return dotOne->cons(h);
-}
-
-// digit matrices: section 9.1
-struct Digits {
-    const int d0;
-    const int d1;
-
-    Digits(int d0, int d1) : d0(d0), d1(d1) {}
+        return fclose(f) == 0;
+    }
 
-    // n = d0, c = d1
-    Mat to_mat() const {
-        const int pow2 = 1 << d0;
-        return Mat(pow2 + d1 + 1, pow2 - d1 - 1, pow2 + d1 - 1, pow2 - d1 + 1);
+    static Trace &get() {
+        static thread_local Trace t;
+        return t;
     }
+
+private:
+    std::vector<TraceRecord> ring;
+    uint64_t seq = 0;
 };
 
-Expr *erec(const Expr *e) {
-    return new MatExpr(Mat(0, 1, 1, 0), ExprThunk::thunkify(e));
+template<typename T>
+int coeffBits(const VecT<T> &v) { return std::max(bitLength(v.v0), bitLength(v.v1)); }
+
+template<typename T>
+int coeffBits(const MatT<T> &m) { return std::max(coeffBits(m.v0()), coeffBits(m.v1())); }
+
+template<typename T>
+int coeffBits(const TensorT<T> &t) { return std::max(coeffBits(t.m0()), coeffBits(t.m1())); }
+
+int coeffBits(const LFT &l) {
+    return l.visit([](const auto &x) { return coeffBits(x); });
 }
 
-struct Uefp {
-    const Digits digits;
-    const Expr *e;
+#if FRACTIONS_TRACE
+#define TRACE(ev, arg, depth, lft) Trace::get().record(TraceEvent::ev, (arg), (depth), coeffBits(lft))
+#else
+#define TRACE(ev, arg, depth, lft) ((void) 0)
+#endif
+
+#if FRACTIONS_TRACE >= 2
+#define TRACE_LOG(x) (cerr << x)
+#else
+#define TRACE_LOG(x) ((void) 0)
+#endif
+
+// An argument of an expression node. Cells are shared: app() hands the
+// argument cells of its operands straight to the node it builds, so a value
+// is computed once however many nodes refer to it, and forcing an argument
+// never walks a chain of forwarding closures.
+//
+// Cells may be forced from several threads at once (by Pool workers, or by
+// evaluations sharing a graph such as epiShared()). The memo is a single
+// atomic pointer: once it is published, get() is one acquire load. The
+// first thread to claim an unforced cell runs the thunk; any other thread
+// that gets there meanwhile waits for it to publish, so every thunk runs
+// exactly once. Thunks never wait on the pool: most only build nodes, and
+// the few that evaluate their argument to build theirs (Blocks) run that
+// evaluation serially, under a PoolScope of their own. So a waiter is only
+// ever held up for the length of one thunk, never for pool work behind it.
+//
+// A cell with a thunk is a ClosureThunk, which holds the closure inline and
+// calls it through a plain function pointer: building one is a single node
+// allocation, and forcing it is one indirect call. See delay().
+struct Relocation;
+struct CheckpointWriter;
 
-    Uefp(Digits digits, const Expr *e) : digits(digits), e(e) {};
+struct ExprThunk {
+    // an argument that is already known.
+    explicit ExprThunk(const Expr *e) : persistent(false), value(e) {};
 
-    Uefp urec() const { return Uefp(Digits(digits.d0, -digits.d1), erec(e)); }
+    // only for known arguments, and only before the cell is shared.
+    ExprThunk(ExprThunk &&other)
+            : persistent(other.persistent), value(other.value.load(std::memory_order_relaxed)) {
+        assert(other.ops == nullptr && "would slice the closure off");
+    };
 
-    const Expr *to_expr() const {
-        return new MatExpr(digits.to_mat(), ExprThunk::thunkify(e));
+    const Expr *get() const {
+        const Expr *v = value.load(std::memory_order_acquire);
+        if (v != nullptr && v != forcing()) {
+            return v;
+        }
+        return force();
     }
-};
 
-// signed exact floating point
-enum class SefpType {
-    Positive, Negative, Inf, Zero
-};
+    // the value if it is known already, without forcing.
+    const Expr *peek() const {
+        const Expr *v = value.load(std::memory_order_acquire);
+        return v == forcing() ? nullptr : v;
+    }
 
-struct Sefp {
-    const SefpType type;
-    const Uefp uefp;
+    // whether the cell was built around a known argument rather than a
+    // closure, forced or not.
+    bool literal() const { return ops == nullptr; }
 
-    Sefp(SefpType ty, Uefp uefp) : type(type), uefp(uefp) {}
+    static ExprThunk thunkify(const Expr *e) {
+        return ExprThunk(e);
+    }
 
-    Sefp srec() const { return Sefp(type, uefp.urec()); }
+    // a copy of this unforced cell in the current arena, see Relocation.
+    const ExprThunk *relocated(Relocation &r) const {
+        assert(ops != nullptr && peek() == nullptr);
+        return ops->relocate(this, r);
+    }
 
-    Mat to_mat() const {
-        switch (type) {
-            case SefpType::Positive:
-                return spos.dot(uefp.digits.to_mat());
-            case SefpType::Negative:
-                return sneg.dot(uefp.digits.to_mat());
-            case SefpType::Inf:
-                return sinf.dot(uefp.digits.to_mat());
-            case SefpType::Zero:
-                return szer.dot(uefp.digits.to_mat());
-        }
+    // the node an unforced cell's closure is applied to, if any.
+    const Expr *bound() const {
+        assert(ops != nullptr);
+        return ops->bound(this);
     }
-};
 
-// fair (11.9)
-int strategyf(Tensor t, int i) { return (i % 2) + 1; }
+    // write this unforced cell's closure to a checkpoint; false if it has no
+    // checkpoint form.
+    bool save(CheckpointWriter &w) const {
+        assert(ops != nullptr && peek() == nullptr);
+        return ops->save(this, w);
+    }
 
-// refine (11.10)
-int strategyr(Tensor t, int i) {
-    return Mat::disjoint(t.transpose().m0(), t.transpose().m1()) ? 2 : 1;
-}
+protected:
+    // what a ClosureThunk<F> does, per F.
+    struct Ops {
+        const Expr *(*call)(const ExprThunk *);
+        const ExprThunk *(*relocate)(const ExprThunk *, Relocation &);
+        const Expr *(*bound)(const ExprThunk *);
+        bool (*save)(const ExprThunk *, CheckpointWriter &);
+    };
 
-// information overlap (11.10)
-int strategyo(Tensor t, int i) {
-    if (t.refine()) {
-        return strategyr(t, i);
-    } else {
-        return strategyf(t, i);
+    explicit ExprThunk(const Ops *ops) : ops(ops), persistent(Arena::current() == nullptr) {};
+
+private:
+    // marks a cell whose thunk is running.
+    static const Expr *forcing() {
+        static const char mark = 0;
+        return reinterpret_cast<const Expr *>(&mark);
     }
-}
 
-// decision (11.11)
-bool decision(int i, const LFT *lft) {
-    if (i == 1) {
-        if (lft->isa<Mat>()) {
-            return true;
-        } else if (const Tensor *t = lft->dyn_cast<Tensor>()) {
-            return strategyo(*t, i) == 1;
+    const Expr *force() const {
+        const Expr *v = nullptr;
+        if (value.compare_exchange_strong(v, forcing(), std::memory_order_acquire)) {
+            if (persistent) {
+                // a heap node outlives any evaluation arena, so whatever it
+                // memoizes must be on the heap too.
+                ArenaScope heap(nullptr);
+                v = ops->call(this);
+            } else {
+                v = ops->call(this);
+            }
+            value.store(v, std::memory_order_release);
+            return v;
+        }
+        while ((v = value.load(std::memory_order_acquire)) == forcing()) {
+            std::this_thread::yield();
+        }
+        return v;
+    }
+
+    const Ops *ops = nullptr;
+    bool persistent;
+    mutable std::atomic<const Expr *> value{nullptr};
+};
+
+// whether a closure has a checkpoint form: a bool save(CheckpointWriter &).
+template<typename F, typename = void>
+struct Saveable : std::false_type {};
+
+template<typename F>
+struct Saveable<F, std::void_t<decltype(std::declval<const F &>().save(std::declval<CheckpointWriter &>()))>>
+        : std::true_type {};
+
+template<typename F>
+struct ClosureThunk : public ExprThunk {
+    explicit ClosureThunk(F f, const Expr *arg = nullptr) : ExprThunk(&closureOps), f(std::move(f)), arg(arg) {};
+
+private:
+    static const Expr *call(const ExprThunk *t) {
+        const ClosureThunk *c = static_cast<const ClosureThunk *>(t);
+        if constexpr (std::is_invocable<const F &>::value) {
+            return c->f();
         } else {
-            assert(false && "must be matrix or tensor");
+            return c->f(c->arg);
         }
-    } else {
-        assert(i == 2);
-        const Tensor *t = lft->cast<Tensor>();
-        return strategyo(*t, i) == 2;
     }
+
+    static const ExprThunk *copy(const ExprThunk *t, Relocation &r);
+
+    static const Expr *boundArg(const ExprThunk *t) { return static_cast<const ClosureThunk *>(t)->arg; }
+
+    static bool saveClosure(const ExprThunk *t, CheckpointWriter &w);
+
+    static const Ops closureOps;
+
+    const F f;
+    const Expr *const arg;  // what f is applied to, for closures of one node
+};
+
+template<typename F>
+const ExprThunk::Ops ClosureThunk<F>::closureOps = {
+        &ClosureThunk::call, &ClosureThunk::copy, &ClosureThunk::boundArg, &ClosureThunk::saveClosure};
+
+// a cell that runs f() the first time it is forced. f captures values only:
+// a closure that needs a node takes it as a parameter, and delay(f, x) binds
+// it to x, which keeps the cell relocatable (see Relocation).
+template<typename F>
+const ExprThunk *delay(F f) {
+    return mk<ClosureThunk<F>>(std::move(f));
 }
 
-// ===Normalization functions===
-// Absorption function (11.4)
-const Expr *ab(const LFT *k, const Expr *e, bool b);
+// a cell that runs f(x) the first time it is forced.
+template<typename F>
+const ExprThunk *delay(F f, const Expr *x) {
+    return mk<ClosureThunk<F>>(std::move(f), x);
+}
 
-Sefp sem(const Expr *e, int i);
 
-Uefp dem(Digits d, const Expr *e, int i);
+enum class ExprType {
+    Vec = 'v', Mat = 'm', Tensor = 't'
+};
 
-template<typename T>
-std::function<T(int)> one(T t) {
-    return [t](int i) {
-        assert(i == 1);
-        return t;
-    };
+// An expression is an LFT head, stored inline, applied to as many lazily
+// computed arguments as the head has branches. VecExpr, MatExpr and
+// TensorExpr only add the argument thunks; which one a node is follows from
+// the type of its head, so tail() switches on that instead of a vtable.
+struct Expr {
+    const LFT lft;
+
+    ExprType exprty() const {
+        switch (lft.type()) {
+            case LFTType::Vec:
+                return ExprType::Vec;
+            case LFTType::Mat:
+                return ExprType::Mat;
+            case LFTType::Tensor:
+                return ExprType::Tensor;
+        }
+        assert(false && "unknown lft type");
+    }
+
+    const LFT &head() const { return lft; }
+
+    const Expr *tail(int i) const;
+
+    const ExprThunk *tailThunk(int i) const;
+
+protected:
+    Expr(LFT lft) : lft(std::move(lft)) {};
+};
+
+struct VecExpr : public Expr {
+    VecExpr(Vec v) : Expr(std::move(v)) {}
+};
+
+struct MatExpr : public Expr {
+    const ExprThunk *const ethunk;
+
+    MatExpr(Mat m, ExprThunk ethunk) : MatExpr(std::move(m), mk<ExprThunk>(std::move(ethunk))) {}
+
+    MatExpr(Mat m, const ExprThunk *ethunk) : Expr(std::move(m)), ethunk(ethunk) {}
+};
+
+// counter for each tensor, fair absorption (section 11.6), is Tensor::n.
+struct TensorExpr : public Expr {
+    const ExprThunk *const lthunk;
+    const ExprThunk *const rthunk;
+
+    TensorExpr(Tensor t, ExprThunk lthunk, ExprThunk rthunk)
+            : TensorExpr(std::move(t), mk<ExprThunk>(std::move(lthunk)), mk<ExprThunk>(std::move(rthunk))) {};
+
+    TensorExpr(Tensor t, const ExprThunk *lthunk, const ExprThunk *rthunk)
+            : Expr(std::move(t)), lthunk(lthunk), rthunk(rthunk) {};
+};
+
+const ExprThunk *Expr::tailThunk(int i) const {
+    switch (lft.type()) {
+        case LFTType::Vec:
+            assert(false && "vec has no tail!");
+            exit(1);
+        case LFTType::Mat:
+            assert(i == 1);
+            return static_cast<const MatExpr *>(this)->ethunk;
+        case LFTType::Tensor: {
+            assert(i == 1 || i == 2);
+            const TensorExpr *t = static_cast<const TensorExpr *>(this);
+            return i == 1 ? t->lthunk : t->rthunk;
+        }
+    }
+    assert(false && "unknown lft type");
 }
 
-// Sign emission (11.1)
-Sefp sem(const Expr *e, int i) {
-    const LFT *l = e->head();
-
-    debugPrompt(__PRETTY_FUNCTION__);
-    ScopedIndenter indent(cerr, __PRETTY_FUNCTION__);
-    cerr << *e << "\n";
-    auto f = [e, l](int d) { 
-        ScopedIndenter indent(cerr, __PRETTY_FUNCTION__);
-        cerr << "- d:" << d << "\n";
-        cerr << "- e->tail(d):" << *e->tail(d) << "\n";
-        cerr << "- decision(d,l):" << decision(d,l) << "\n";
-        const Expr *out = ab(l, e->tail(d), decision(d, l));
-        cerr << "- ab(l, e->tail(d), decision(d, l)):" << *out << "\n";
-        return out;
-    };
-    cerr << "- l: " << *l << "\n";
-    cerr << "- isPos: " << ispos << "\n";
-    cerr << "- LFT::dot(1, &ispos, l): " << *LFT::dot(1, &ispos, l) << "\n";
-    cerr << "- LFT::dot(1, &ispos, l)->refine(): " << LFT::dot(1, &ispos, l)->refine() << "\n";
-    if (LFT::dot(1, &ispos, l)->refine()) {
-        return Sefp(SefpType::Positive,
-                    dem(Digits(0, 0), ispos.app(one(e)), i));
-    } else if (LFT::dot(1, &isneg, l)->refine()) {
-        return Sefp(SefpType::Negative,
-                    dem(Digits(0, 0), isneg.app(one(e)), i));
-    } else if (LFT::dot(1, &iszer, l)->refine()) {
-        return Sefp(SefpType::Negative,
-                    dem(Digits(0, 0), iszer.app(one(e)), i));
-    } else if (LFT::dot(1, &isinf, l)->refine()) {
-        return Sefp(SefpType::Negative,
-                    dem(Digits(0, 0), isinf.app(one(e)), i));
-    } else {
-        const Expr *lapp = l->app(f);
-        cerr << "- l->app(f):" << *lapp << "\n";
-        return sem(l->app(f), i);
-    }
-}
-
-// Digit emission (11.2)
-Uefp dem(Digits d, const Expr *e, int j) {
-    const LFT *l = e->head();
-    auto f = [e, l](int d) { return ab(l, e->tail(d), decision(d, l)); };
-    if (j == 0 || l->isa<Vec>()) {
-        return Uefp(d, e);
-    } else if (LFT::dot(1, &idneg, l)->refine()) {
-        return dem(Digits(d.d0 + 1, 2 * d.d1 - 1),
-                   LFT::dot(1, &idneg, l)->app(one(e)), j - 1);
-    } else if (LFT::dot(1, &idpos, l)->refine()) {
-        return dem(Digits(d.d0 + 1, 2 * d.d1 + 1),
-                   LFT::dot(1, &idpos, l)->app(one(e)), j - 1);
-    } else if (LFT::dot(1, &idzer, l)->refine()) {
-        return dem(Digits(d.d0 + 1, 2 * d.d1),
-                   LFT::dot(1, &idzer, l)->app(one(e)), j - 1);
-    } else {
-        return dem(d, l->app(f), j);
+const Expr *Expr::tail(int i) const { return tailThunk(i)->get(); }
+
+OutFile &operator<<(OutFile &o, const Expr &e) {
+    return o << "Expr(" << (char) e.exprty() << " " << (void *) &e << " = " << e.head() << ")";
+}
+
+// page 188: a node with head lft whose arguments are the cells ts[0..branch).
+const Expr *cons(const Vec &v, const ExprThunk *const *ts) {
+    return mk<VecExpr>(v);
+}
+
+const Expr *cons(const Mat &m, const ExprThunk *const *ts) {
+    return mk<MatExpr>(m, ts[0]);
+}
+
+const Expr *cons(const Tensor &t, const ExprThunk *const *ts) {
+    return mk<TensorExpr>(t, ts[0], ts[1]);
+}
+
+// what identifies an argument cell for hash consing: its value once known,
+// so distinct cells holding the same node match.
+uintptr_t cellKey(const ExprThunk *t) {
+    const Expr *v = t->peek();
+    return v ? (uintptr_t) v : (uintptr_t) t;
+}
+
+// Hash consing: inside an arena, a node with the same head and arguments as
+// one built there before is that node. Equal subgraphs, such as the two
+// sides of x * x once both have been advanced, are then one graph, and run()
+// advances them once (see advanced()). A cell forced after its node was
+// interned hashes differently from then on, which only loses the sharing.
+const Expr *LFT::cons(const ExprThunk *const *ts) const {
+    Arena *arena = Arena::current();
+    if (!arena) {
+        return visit([ts](const auto &x) { return ::cons(x, ts); });
+    }
+    size_t h = hash();
+    for (int i = 0; i < branch(); ++i) { h = hashMix(h, cellKey(ts[i])); }
+    const void *hit = arena->interned.find(h, [this, ts](const void *p) {
+        const Expr *e = static_cast<const Expr *>(p);
+        if (!(e->head() == *this)) { return false; }
+        for (int i = 0; i < branch(); ++i) {
+            if (cellKey(e->tailThunk(i + 1)) != cellKey(ts[i])) { return false; }
+        }
+        return true;
+    });
+    if (hit) {
+        Stats::get().shared++;
+        return static_cast<const Expr *>(hit);
     }
+    const Expr *e = visit([ts](const auto &x) { return ::cons(x, ts); });
+    arena->interned.insert(h, e, e);
+    return e;
 }
 
-// Absorption function (11.4)
-const Expr *ab(const LFT *k, const Expr *e, bool b) {
-    if (!b) {
-        return Uefp(Digits(0, 0), e).to_expr();
-    } else if (k->isa<Tensor>() && e->head()->isa<Tensor>()) {
-        return Uefp(dem(Digits(0, 1), e, 1)).to_expr();
-    } else {
-        return e;
+// Copies everything reachable from a node that was allocated in the arena
+// `from` into the current arena, preserving sharing. Anything outside from
+// (the heap, other arenas) is referred to as is, so from can be reset
+// afterwards provided nothing outside it points in: true of a graph built
+// in from, since cells hold their closure's node as a bound argument (see
+// delay) and heap cells only ever memoize heap nodes.
+struct Relocation {
+    explicit Relocation(const Arena &from) : from(from) {};
+
+    const Expr *operator()(const Expr *e) {
+        if (e == nullptr || !from.owns(e)) {
+            return e;
+        }
+        auto it = moved.find(e);
+        if (it != moved.end()) {
+            return static_cast<const Expr *>(it->second);
+        }
+        const ExprThunk *ts[2];
+        for (int i = 0; i < e->head().branch(); ++i) {
+            ts[i] = (*this)(e->tailThunk(i + 1));
+        }
+        const Expr *out = e->head().cons(ts);
+        moved[e] = out;
+        return out;
+    }
+
+    const ExprThunk *operator()(const ExprThunk *t) {
+        if (!from.owns(t)) {
+            return t;
+        }
+        auto it = moved.find(t);
+        if (it != moved.end()) {
+            return static_cast<const ExprThunk *>(it->second);
+        }
+        const Expr *v = t->peek();
+        const ExprThunk *out = v ? mk<ExprThunk>((*this)(v)) : t->relocated(*this);
+        moved[t] = out;
+        return out;
     }
+
+private:
+    const Arena &from;
+    std::unordered_map<const void *, const void *> moved;
+};
+
+template<typename F>
+const ExprThunk *ClosureThunk<F>::copy(const ExprThunk *t, Relocation &r) {
+    const ClosureThunk *c = static_cast<const ClosureThunk *>(t);
+    return mk<ClosureThunk>(c->f, r(c->arg));
 }
 
-std::string mshow(Mat m);
+// ===Checkpoints===
+// A checkpoint is a graph written out as a flat list of records, each
+// after the ones it refers to, which refer to each other by index. A node
+// record holds the coefficients of the head and the indices of its cells. A
+// cell record holds either the node it is known to be, or its closure as the
+// builder that made it and how far along it is: which series, and the index
+// of its next term, say. Closures without such a form (see Saveable) make a
+// graph unsaveable. Integers are little endian, BigInts are a sign byte and
+// a count of 32-bit limbs, least significant first. DigitStream::save puts
+// the stream's state around it.
+enum class Record : uint8_t {
+    Vec = 'V', Mat = 'M', Tensor = 'T', Known = 'C', Closure = 'K'
+};
 
-std::string sshow(deque<int> numbers);
+struct CheckpointWriter {
+    static const uint32_t none = 0xffffffff;
 
-std::deque<int> scientific(Mat mat, int i);
+    std::string out;
+    bool ok = true;  // false once something had no checkpoint form
 
-std::deque<int> mantissa(int i, int n, Mat mat);
+    void u8(uint8_t x) { out.push_back((char) x); }
+
+    void u32(uint32_t x) {
+        for (int i = 0; i < 4; ++i) { u8((uint8_t) (x >> (8 * i))); }
+    }
 
-std::string eshow(const Expr *e, int i) { return mshow(sem(e, i).to_mat()); }
+    void i32(int32_t x) { u32((uint32_t) x); }
 
-std::string mshow(Mat m) {
-    const int d = m.determinant();
-    Vec v = m.v0().scale();
-    const int p = v.v0;
-    const int q = v.v1;
-    if (d == 0) {
-        if (q == 1) {
-            return std::to_string(v.v0);
+    void number(const num &x) {
+        const BigInt::Mag m = x.magnitude();
+        u8(x.negative());
+        u32((uint32_t) m.size());
+        for (BigInt::limb l : m) { u32(l); }
+    }
+
+    void vec(const Vec &v) {
+        number(v.v0);
+        number(v.v1);
+    }
+
+    void mat(const Mat &m) {
+        vec(m.v0());
+        vec(m.v1());
+    }
+
+    // the index of an already written node or cell, or none.
+    uint32_t indexOf(const void *p) const {
+        auto it = index.find(p);
+        return it == index.end() ? none : it->second;
+    }
+
+    // write the graph below root, skipping what is already written, and
+    // return root's index. Postorder on an explicit stack: a series another
+    // evaluation has forced far ahead is a chain of any length.
+    uint32_t graph(const Expr *root) {
+        struct Item {
+            const void *p;
+            bool cell;
+            bool expanded;
+        };
+        std::vector<Item> stack{{root, false, false}};
+        while (!stack.empty() && ok) {
+            const Item it = stack.back();
+            if (index.count(it.p)) {
+                stack.pop_back();
+                continue;
+            }
+            if (!it.expanded) {
+                stack.back().expanded = true;
+                if (it.cell) {
+                    const ExprThunk *t = static_cast<const ExprThunk *>(it.p);
+                    const Expr *v = t->peek();
+                    if (const Expr *x = v ? v : t->bound()) { stack.push_back({x, false, false}); }
+                } else {
+                    const Expr *e = static_cast<const Expr *>(it.p);
+                    for (int i = e->head().branch(); i >= 1; --i) { stack.push_back({e->tailThunk(i), true, false}); }
+                }
+                continue;
+            }
+            stack.pop_back();
+            if (it.cell) {
+                cell(static_cast<const ExprThunk *>(it.p));
+            } else {
+                node(static_cast<const Expr *>(it.p));
+            }
+            index[it.p] = nrecords++;
+        }
+        return indexOf(root);
+    }
+
+    uint32_t records() const { return nrecords; }
+
+private:
+    void node(const Expr *e) {
+        const LFT &l = e->head();
+        if (const Vec *v = l.dyn_cast<Vec>()) {
+            u8((uint8_t) Record::Vec);
+            vec(*v);
+        } else if (const Mat *m = l.dyn_cast<Mat>()) {
+            u8((uint8_t) Record::Mat);
+            mat(*m);
         } else {
-            return std::to_string(p) + "/" + std::to_string(q);
+            const Tensor &t = l.cast<Tensor>();
+            u8((uint8_t) Record::Tensor);
+            mat(t.ms[0]);
+            mat(t.ms[1]);
+            i32(t.n);
         }
-    } else {
-        return sshow(scientific(m, 0));
+        for (int i = 1; i <= l.branch(); ++i) { u32(indexOf(e->tailThunk(i))); }
     }
-}
 
-int powi(int base, int exp) {
-    int ans = 1;
-    for (int i = 0; i < exp; ++i) {
-        ans *= base;
+    void cell(const ExprThunk *t) {
+        if (const Expr *v = t->peek()) {
+            u8((uint8_t) Record::Known);
+            u32(indexOf(v));
+        } else {
+            u8((uint8_t) Record::Closure);
+            ok = ok && t->save(*this);
+        }
     }
-    return ans;
-}
 
-std::tuple<int, int, int> normalize(int e, int l, int v) {
-    if (l > 0 && abs(v) < powi(10, l - 1)) {
-        return normalize(e - 1, l - 1, v);
+    std::unordered_map<const void *, uint32_t> index;
+    uint32_t nrecords = 0;
+};
+
+// A closure record is its payload (see loadClosure) followed by the index of
+// the node it is bound to, or none.
+template<typename F>
+bool ClosureThunk<F>::saveClosure(const ExprThunk *t, CheckpointWriter &w) {
+    if constexpr (Saveable<F>::value) {
+        const ClosureThunk *c = static_cast<const ClosureThunk *>(t);
+        if (!c->f.save(w)) {
+            return false;
+        }
+        w.u32(c->arg ? w.indexOf(c->arg) : CheckpointWriter::none);
+        return true;
     } else {
-        return std::make_tuple(e, l, v);
+        return false;
     }
 }
 
-std::string sshow(deque<int> numbers) {
-    if (numbers.size() == 0) {
-        return "unbounded";
+// Reads what CheckpointWriter wrote, building the nodes in the current
+// arena. Every read is bounds checked: a short or corrupt file clears ok
+// and yields zeros from then on, never a read outside the buffer.
+struct CheckpointReader {
+    CheckpointReader(const char *p, const char *end) : p(p), end(end) {};
+
+    bool ok = true;
+
+    uint8_t u8() {
+        if (!ok || p == end) {
+            ok = false;
+            return 0;
+        }
+        return (uint8_t) *p++;
     }
-    const int e = numbers[0];
 
-    int f = 0;
-    for (int i = numbers.size() - 1; i >= 1; i--) {
-        f = f * 10 + numbers[i];
+    uint32_t u32() {
+        uint32_t x = 0;
+        for (int i = 0; i < 4; ++i) { x |= (uint32_t) u8() << (8 * i); }
+        return x;
     }
 
-    int h, l, v;
-    std::tie(h, l, v) = normalize(e, numbers.size() - 1, f);
+    int32_t i32() { return (int32_t) u32(); }
 
-    std::string out = "";
-    if (v < 0) {
-        out += "-";
+    num number() {
+        const bool neg = u8() != 0;
+        const uint32_t n = u32();
+        if (!ok || (size_t) (end - p) / 4 < n) {
+            ok = false;
+            return 0;
+        }
+        BigInt::Mag m(n);
+        for (uint32_t i = 0; i < n; ++i) { m[i] = u32(); }
+        return BigInt::fromMagnitude(neg, std::move(m));
     }
-    if (v == 0) {
-        out += "0";
-    } else {
-        out += "0" + std::to_string(abs(v));
+
+    Vec vec() {
+        const num v0 = number();
+        return Vec(v0, number());
     }
-    out += "e";
-    out += std::to_string(h);
-    return out;
+
+    Mat mat() {
+        const Vec v0 = vec();
+        return Mat(v0, vec());
+    }
+
+    // the graph written by CheckpointWriter::graph(), or nullptr.
+    const Expr *graph();
+
+    // record i, which must be a node.
+    const Expr *nodeAt(uint32_t i) {
+        const Record r = i < records.size() ? records[i].first : Record::Known;
+        return static_cast<const Expr *>(at(i, r == Record::Vec || r == Record::Mat || r == Record::Tensor));
+    }
+
+    // record i, which must be a cell.
+    const ExprThunk *cellAt(uint32_t i) {
+        const Record r = i < records.size() ? records[i].first : Record::Vec;
+        return static_cast<const ExprThunk *>(at(i, r == Record::Known || r == Record::Closure));
+    }
+
+private:
+    const void *at(uint32_t i, bool wellTyped) {
+        ok = ok && wellTyped;
+        return ok ? records[i].second : nullptr;
+    }
+
+    const char *p;
+    const char *const end;
+    std::vector<std::pair<Record, const void *>> records;
+};
+
+// decodes the closure record at the reader's position, see the builders.
+const ExprThunk *loadClosure(CheckpointReader &r);
+
+const Expr *CheckpointReader::graph() {
+    const uint32_t n = u32();
+    for (uint32_t i = 0; i < n && ok; ++i) {
+        const Record tag = (Record) u8();
+        const void *rec = nullptr;
+        switch (tag) {
+            case Record::Vec:
+                rec = LFT(vec()).cons(nullptr);
+                break;
+            case Record::Mat: {
+                const Mat m = mat();
+                const ExprThunk *ts[1] = {cellAt(u32())};
+                rec = ok ? LFT(m).cons(ts) : nullptr;
+                break;
+            }
+            case Record::Tensor: {
+                const Mat m0 = mat();
+                const Mat m1 = mat();
+                const int n = i32();
+                const ExprThunk *ts[2];
+                ts[0] = cellAt(u32());
+                ts[1] = cellAt(u32());
+                rec = ok ? LFT(Tensor(m0, m1, n)).cons(ts) : nullptr;
+                break;
+            }
+            case Record::Known: {
+                const Expr *v = nodeAt(u32());
+                rec = ok ? mk<ExprThunk>(v) : nullptr;
+                break;
+            }
+            case Record::Closure:
+                rec = loadClosure(*this);
+                ok = ok && rec != nullptr;
+                break;
+            default:
+                ok = false;
+        }
+        records.push_back({tag, rec});
+    }
+    const Expr *root = nodeAt(u32());
+    return ok ? root : nullptr;
 }
 
-std::deque<int> scientific(Mat m, int n) {
-    if (m.inverse().dot(Vec(1, 0)).refine()) {
-        return {};
-    } else if (szer.inverse().dot(m).refine()) {
-        deque<int> ss = mantissa(-9, 9, m);
-        ss.push_front(n);
-        return ss;
-    } else {
-        return scientific(Mat(1, 0, 0, 10).dot(m), n + 1);
+
+// Page 185
+Vec dot1(const Mat &m, const Vec &v) { return m.dot(v).scale(); }
+
+Mat dot1(const Mat &m, const Mat &n) { return m.dot(n).scale(); }
+
+Tensor dot1(const Mat &m, const Tensor &t) { return m.dot(t).scale(); }
+
+Mat dot1(const Tensor &t, const Vec &v) { return t.left(v).scale(); }
+
+Tensor dot1(const Tensor &t, const Mat &m) {
+    if (m == Mat::identity()) {
+        return t;
     }
+    return t.left(m).scale().bumpn();
 }
 
-std::deque<int> mantissa(int i, int n, Mat mat) {
-    Mat d(i + 1, 10, i - 1, 10);
-    if (d.inverse().dot(mat).refine()) {  // c i
-        Mat e(10, 0, -i, 1);
-        std::deque<int> ss = mantissa(-9, 9, e);
-        ss.push_front(i);
-        return ss;
-    } else if (i < n) {
-        return mantissa(i + 1, n, mat);
-    } else {
-        return {};
+// same as dot1, just left switched to right
+Mat dot2(const Tensor &t, const Vec &v) { return t.right(v).scale(); }
+
+Tensor dot2(const Tensor &t, const Mat &m) {
+    if (m == Mat::identity()) {
+        return t;
     }
+    return t.right(m).scale().bumpn();
 }
 
-// TODO: elementary functions.
+// every other pairing is not a well formed product.
+template<typename L, typename R>
+LFT dot1(const L &l, const R &r) {
+    assert(false && "dot 1: left must be a matrix, or a tensor applied to a vector/matrix");
+    exit(1);
+}
 
-const Expr *eiterate(std::function<Mat(int)> f, int n) {
-    // this needs to be lazy, will instantly blow up
-    return new MatExpr(f(n),
-                       ExprThunk([f, n]() { return eiterate(f, n + 1); }));
+template<typename L, typename R>
+LFT dot2(const L &l, const R &r) {
+    assert(false && "dot 2: left must be a tensor applied to a vector/matrix");
+    exit(1);
 }
 
-const Expr *eiteratex(std::function<Tensor(int)> f, int n, const Expr *x) {
-    return new TensorExpr(
-            f(n), 0, ExprThunk::thunkify(x),
-            ExprThunk([f, n, x]() { return eiteratex(f, n + 1, x); }));
+// products where the left operand is statically known.
+LFT dot1(const Mat &m, const LFT &r) {
+    return r.visit([&m](const auto &x) { return LFT(dot1(m, x)); });
 }
 
-const Expr *rollover(int a, int b, int c) {
-    const int d = 2 * (b - a) + c;
-    if (d >= 0) {
-        return new MatExpr(
-                dneg, ExprThunk([a, d, c]() { return rollover(4 * a, d, c); }));
-    } else {
-        return new MatExpr(
-                dpos, ExprThunk([b, d, c]() { return rollover(-d, 4 * b, c); }));
-    }
+LFT dot1(const Tensor &t, const LFT &r) {
+    return r.visit([&t](const auto &x) { return LFT(dot1(t, x)); });
 }
 
-// p/q
-const Expr *esqrtrat(int p, int q) { return rollover(p, q, p - q); }
+LFT dot2(const Tensor &t, const LFT &r) {
+    return r.visit([&t](const auto &x) { return LFT(dot2(t, x)); });
+}
 
-// sqrt(x) for any x.
-const Expr *esqrtspos(const Expr *e) {
-    return eiteratex(
-            [](int n) { return Tensor(Mat(1, 0, 2, 1), Mat(1, 2, 0, 1)); }, 0, e);
+LFT LFT::dot(int i, const LFT &l, const LFT &r) {
+    assert(i == 1 || i == 2);
+    return std::visit([i](const auto &a, const auto &b) {
+        return i == 1 ? LFT(dot1(a, b)) : LFT(dot2(a, b));
+    }, l.lft, r.lft);
 }
 
-// elogpos(x) = log(S+(x))
-const Expr *elogpos(const Expr *e) {
-    return eiteratex(
-            [](int n) {
-                if (n == 0) {
-                    return Tensor(Mat(1, 0, 1, 1), Mat(-1, 1, -1, 0));
-                } else {
-                    return Tensor(Mat(n, 0, 2 * n + 1, n + 1),
-                                  Mat(n + 1, 2 * n + 1, 0, n));
-                };
-            },
-            0, e);
+// the arguments of x followed by those of y.
+int tailThunks(const Expr *x, const Expr *y, const ExprThunk **ts) {
+    int n = 0;
+    for (const Expr *e : {x, y}) {
+        for (int i = 1; e && i <= e->head().branch(); ++i) {
+            assert(n < 2 && "absorbing these would give more than two arguments");
+            ts[n++] = e->tailThunk(i);
+        }
+    }
+    return n;
 }
 
-// ee = natural exp
-const Expr *ee() {
-    return eiterate(
-            [](int n) { return Mat(2 * n + 2, 2 * n + 1, 2 * n + 1, 2 * n); }, 0);
+// app (page 188) with the arguments already absorbed: x (and y) are what
+// ab() returned for each side, so nothing here is lazy any more.
+const Expr *app(const Mat &m, const Expr *x) {
+    const ExprThunk *ts[2];
+    tailThunks(x, nullptr, ts);
+    return dot1(m, x->head()).cons(ts);
 }
 
-// Pi: section 10.2.4
+const Expr *app(const Tensor &t, const Expr *x, const Expr *y) {
+    const ExprThunk *ts[2];
+    tailThunks(x, y, ts);
+    const LFT dotTwo = dot2(t, y->head());
+    const LFT dotOne = LFT::dot(1, dotTwo, x->head());
+    TRACE_LOG("app " << t << " x: " << *x << " y: " << *y << " = " << dotOne << "\n");
+    return dotOne.cons(ts);
+}
 
-const Expr *epi() {
-    const Expr *eomega = eiterate(
-            [](int n) {
-                if (n == 0) {
-                    return Mat(6795705, 213440, 6795704, 213440);
-                } else {
-                    const int b = (2 * n - 1) * (6 * n - 5) * (6 * n - 1);
-                    const int c = b * (545140134 * n + 13591409);
-                    const int d = b * (n + 1);
-                    const int e = 10939058860032000 * powi(n, 4);
-                    return Mat(b, c, d, e);
-                }
-            },
-            0);
-    return new TensorExpr(tdiv, 0, ExprThunk::thunkify(esqrtrat(1005, 1)),
-                          ExprThunk::thunkify(eomega));
+const Expr *LFT::app(const Expr *const *args) const {
+    switch (type()) {
+        case LFTType::Vec:
+            assert(false && "unimplemented for this class");
+            return nullptr;
+        case LFTType::Mat:
+            return ::app(cast<Mat>(), args[0]);
+        case LFTType::Tensor:
+            return ::app(cast<Tensor>(), args[0], args[1]);
+    }
+    assert(false && "unknown lft type");
 }
 
-// tangent: Section 10.2.5
-const Expr *etanszer() { assert(false && "unimplemented"); }
+// digit matrices: section 9.1
+struct Digits {
+    int d0;
+    num d1;
+
+    Digits(int d0, num d1) : d0(d0), d1(d1) {}
+
+    // n = d0, c = d1
+    Mat to_mat() const {
+        const num pow2 = num(1) << d0;
+        return Mat(pow2 + d1 + 1, pow2 - d1 - 1, pow2 + d1 - 1, pow2 - d1 + 1);
+    }
+};
+
+Expr *erec(const Expr *e) {
+    return mk<MatExpr>(Mat(0, 1, 1, 0), ExprThunk::thunkify(e));
+}
+
+struct Uefp {
+    const Digits digits;
+    const Expr *e;
+
+    Uefp(Digits digits, const Expr *e) : digits(digits), e(e) {};
+
+    Uefp urec() const { return Uefp(Digits(digits.d0, -digits.d1), erec(e)); }
+
+    const Expr *to_expr() const {
+        return mk<MatExpr>(digits.to_mat(), ExprThunk::thunkify(e));
+    }
+
+    // the digits emitted so far; if emission bottomed out at a vector the
+    // value is exact, and the matrix collapses to that single point (utom).
+    Mat to_mat() const {
+        const Mat m = digits.to_mat();
+        if (const Vec *v = e->head().dyn_cast<Vec>()) {
+            return m.dot(Mat(*v, *v)).scale();
+        }
+        return m;
+    }
+};
+
+// signed exact floating point
+enum class SefpType {
+    Positive, Negative, Inf, Zero
+};
+
+struct Sefp {
+    const SefpType type;
+    const Uefp uefp;
+
+    Sefp(SefpType ty, Uefp uefp) : type(ty), uefp(uefp) {}
 
-// arc tangent: Section 10.2.6
-const Expr *earctanszer() { assert(false && "unimplemented"); }
+    Sefp srec() const { return Sefp(type, uefp.urec()); }
 
-int main() {
+    const Mat &sign() const {
+        switch (type) {
+            case SefpType::Positive:
+                return spos;
+            case SefpType::Negative:
+                return sneg;
+            case SefpType::Inf:
+                return sinf;
+            case SefpType::Zero:
+                return szer;
+        }
+        assert(false && "unknown sefp type");
+    }
+
+    Mat to_mat() const { return sign().dot(uefp.to_mat()); }
+
+    // the same number as an expression: the sign and digits as one matrix
+    // applied to the residual.
+    const Expr *to_expr() const {
+        return mk<MatExpr>(sign().dot(uefp.digits.to_mat()).scale(), ExprThunk::thunkify(uefp.e));
+    }
+};
+
+// ===Absorption strategies===
+// A tensor absorbs one argument per step and wraps the other in the identity
+// (11.4); which one is the strategy's call (11.9-11.11). A Strategy sees the
+// tensor and the heads of both its arguments and returns the side to absorb,
+// 1 or 2. Evaluations on a thread use Strategy::current(), which
+// StrategyScope sets. Every strategy yields the same value, only the work to
+// reach each digit differs, and Stats::strategyDigits/strategyTerms measure
+// that per strategy.
+struct Strategy {
+    const char *name;
+    int (*choose)(const Tensor &t, const LFT &x, const LFT &y);
+    int id;  // index into the Stats counters
+
+    // the strategy evaluations on this thread use; overlap unless a
+    // StrategyScope says otherwise.
+    static const Strategy *&current();
+
+    // the built in strategy called name, or nullptr.
+    static const Strategy *byName(const char *name);
+};
+
+// fair (11.9): alternate sides using the tensor's absorption counter.
+int strategyf(const Tensor &t, const LFT &, const LFT &) { return (t.n % 2) + 1; }
+
+// refine (11.10)
+int strategyr(const Tensor &t, const LFT &, const LFT &) {
+    return Mat::disjoint(t.transpose().m0(), t.transpose().m1()) ? 2 : 1;
+}
+
+// information overlap (11.10)
+int strategyo(const Tensor &t, const LFT &x, const LFT &y) {
+    if (t.refine()) {
+        return strategyr(t, x, y);
+    } else {
+        return strategyf(t, x, y);
+    }
+}
+
+// adaptive: the side whose absorption can narrow the image most for the
+// coefficient growth it costs. The corners of a refining tensor's image lie
+// on one side of zero, where p/(p+q) maps them into [0, 1] in order. With y
+// fixed at either end, the corners spread as x moves by at most wx, which is
+// what absorbing x can take off the image's width, and likewise wy for y.
+// Absorbing multiplies the coefficients by the argument head's, so each
+// spread is divided by the bits of that head. An exact argument removes its
+// side altogether and goes first; ties and tensors that do not refine
+// alternate as fair does.
+int strategya(const Tensor &t, const LFT &x, const LFT &y) {
+    if (!t.refine()) {
+        return strategyf(t, x, y);
+    }
+    if (x.isa<Vec>() != y.isa<Vec>()) {
+        return x.isa<Vec>() ? 1 : 2;
+    }
+    const int shift = coeffBits(t);
+    double c[2][2];
+    for (int i = 0; i < 2; ++i) {
+        for (int j = 0; j < 2; ++j) {
+            const double p = t.ms[i].mat[j][0].scaled(shift), q = t.ms[i].mat[j][1].scaled(shift);
+            c[i][j] = p / (p + q);
+        }
+    }
+    const double wx = std::max(__builtin_fabs(c[0][0] - c[1][0]), __builtin_fabs(c[0][1] - c[1][1]));
+    const double wy = std::max(__builtin_fabs(c[0][0] - c[0][1]), __builtin_fabs(c[1][0] - c[1][1]));
+    const double gx = wx / (1 + coeffBits(x)), gy = wy / (1 + coeffBits(y));
+    if (gx > gy) { return 1; }
+    if (gy > gx) { return 2; }
+    return strategyf(t, x, y);
+}
+
+const Strategy strategies[] = {
+        {"fair",     strategyf, 0},
+        {"refine",   strategyr, 1},
+        {"overlap",  strategyo, 2},
+        {"adaptive", strategya, 3},
+};
+
+const Strategy *&Strategy::current() {
+    static thread_local const Strategy *s = &strategies[2];
+    return s;
+}
+
+const Strategy *Strategy::byName(const char *name) {
+    for (const Strategy &s : strategies) {
+        if (strcmp(s.name, name) == 0) { return &s; }
+    }
+    return nullptr;
+}
+
+const char *strategyName(int id) {
+    for (const Strategy &s : strategies) {
+        if (s.id == id) { return s.name; }
+    }
+    return "strategy";
+}
+
+// evaluations on this thread absorb by `strategy` for the lifetime of the
+// scope.
+struct StrategyScope {
+    explicit StrategyScope(const Strategy *strategy) : prev(Strategy::current()) {
+        Strategy::current() = strategy;
+    }
+
+    ~StrategyScope() { Strategy::current() = prev; }
+
+    const Strategy *const prev;
+};
+
+// decision (11.11): the argument of e to absorb this step. A matrix has only
+// the one.
+int decision(const Expr *e) {
+    const LFT &l = e->head();
+    if (const Tensor *t = l.dyn_cast<Tensor>()) {
+        return Strategy::current()->choose(*t, e->tail(1)->head(), e->tail(2)->head());
+    }
+    assert(l.isa<Mat>() && "must be matrix or tensor");
+    return 1;
+}
+
+// ===Normalization functions===
+// sem (11.1), dem (11.2) and ab (11.4) are mutually recursive in the thesis:
+// absorbing a tensor argument into a tensor first runs dem on that argument
+// for one digit. Here they are steps of a loop over an explicit stack of
+// Emission frames on the heap, so the C++ stack depth is the same for 10
+// digits as for 10000, whatever the nesting of the expression.
+
+// one pending sem/dem call.
+struct Speculation;
+
+struct Emission {
+    bool signed_;  // false while still in sem
+    SefpType sign = SefpType::Positive;
+    Digits d = Digits(0, 0);
+    const Expr *e;
+    int j;  // digits still wanted
+    int depth = 0;  // position on the work stack
+    int k = 1;      // most digits one dem step may emit
+    const Expr *from = nullptr;  // for the one digit dem of a tensor argument, that argument
+
+    // absorption (11.4) in progress: the next argument to fetch (0 if none)
+    // and the ones absorbed so far.
+    int next = 0;
+    int side = 0;  // the argument the strategy chose, see decision
+    const Expr *args[2] = {nullptr, nullptr};
+
+    // the other argument of the tensor, being advanced on the pool.
+    std::shared_ptr<Speculation> spec;
+
+    Emission(const Expr *e, int j, bool signed_) : signed_(signed_), e(e), j(j) {}
+
+    bool done() const { return signed_ && (j == 0 || e->head().isa<Vec>()); }
+
+    void emitSign(SefpType ty, const Mat &is) {
+        Stats::get().signs[(int) ty]++;
+        signed_ = true;
+        sign = ty;
+        e = app(is, e);
+        TRACE(Sign, (int) ty, depth, e->head());
+        TRACE_LOG("sign " << (int) ty << ": " << *e << "\n");
+    }
+
+    // emit the digits of block at once.
+    void emitDigits(const Digits &block) {
+        Stats &stats = Stats::get();
+        stats.blocks++;
+        stats.blockDigits += block.d0;
+        stats.strategyDigits[Strategy::current()->id] += block.d0;
+        d = Digits(d.d0 + block.d0, (d.d1 << block.d0) + block.d1);
+        e = app(block.to_mat().inverse(), e);
+        j -= block.d0;
+        TRACE(Digit, block.d0, depth, e->head());
+        TRACE_LOG("digits " << block.d0 << " " << block.d1 << ": " << *e << "\n");
+    }
+
+    void emitDigit(int k, const Mat &id) {
+        Stats &stats = Stats::get();
+        stats.digits[k + 1]++;
+        stats.strategyDigits[Strategy::current()->id]++;
+        d = Digits(d.d0 + 1, 2 * d.d1 + k);
+        e = app(id, e);
+        j--;
+        TRACE(Digit, k, depth, e->head());
+        TRACE_LOG("digit " << k << ": " << *e << "\n");
+    }
+
+    void absorbed(const Expr *x) { args[next++ - 1] = x; }
+};
+
+// calls f(p, q) for every corner p/q of l's image: the point of a vector,
+// the two columns of a matrix, the four of a tensor.
+template<typename F>
+void corners(const LFT &l, F &&f) {
+    if (const Vec *v = l.dyn_cast<Vec>()) {
+        f(v->v0, v->v1);
+    } else if (const Mat *m = l.dyn_cast<Mat>()) {
+        for (const auto &col : m->mat) { f(col[0], col[1]); }
+    } else {
+        for (const Mat &m : l.cast<Tensor>().ms) {
+            for (const auto &col : m.mat) { f(col[0], col[1]); }
+        }
+    }
+}
+
+// ===Sign and digit selection===
+// sem and dem emit the first sign (digit) matrix whose inverse refines the
+// head. Each inverse takes a corner p/q of the head to a vector whose
+// entries are, up to sign, two of the forms below, so classify() works out
+// the sign of each form once per corner and then tests every candidate
+// with integer compares: no LFT products, no scale(), nothing allocated.
+enum Form {
+    P, Q, Sum, Diff, P3, Q3, NForms  // p, q, p + q, p - q, 3p - q, 3q - p
+};
+
+// the inverse of a sign or digit matrix, as the vector (sa a, sb b) it
+// makes of a corner.
+struct Candidate {
+    Form a;
+    int sa;
+    Form b;
+    int sb;
+};
+
+// in the order sem tries them, as in the thesis.
+const SefpType signTypes[] = {SefpType::Positive, SefpType::Negative, SefpType::Zero, SefpType::Inf};
+const Mat *const signInverses[] = {&ispos, &isneg, &iszer, &isinf};
+const Candidate signCandidates[] = {{P, 1, Q, 1}, {Q, 1, P, -1}, {Sum, 1, Diff, -1}, {Diff, 1, Sum, 1}};
+
+// in the order dem tries them.
+const int digitValues[] = {-1, 1, 0};
+const Mat *const digitInverses[] = {&idneg, &idpos, &idzer};
+const Candidate digitCandidates[] = {{P, 1, Diff, -1}, {Diff, 1, Q, 1}, {P3, 1, Q3, 1}};
+
+// index of the first of cands[0..n) that refines l, or -1 if none does.
+int classify(const LFT &l, const Candidate *cands, int n) {
+    int signs[4][NForms];
+    int ncorners = 0;
+    Stats &stats = Stats::get();
+    corners(l, [&](const num &p, const num &q) {
+        int *s = signs[ncorners++];
+        s[P] = sgn(p);
+        s[Q] = sgn(q);
+        s[Sum] = s[P] == s[Q] || s[P] == 0 || s[Q] == 0 ? sgn(s[P] + s[Q]) : Undecided;
+        s[Diff] = s[P3] = s[Q3] = Undecided;
+#if FRACTIONS_FILTER
+        const int shift = std::max(bitLength(p), bitLength(q));
+        const double a = p.scaled(shift), b = q.scaled(shift), size = __builtin_fabs(a) + __builtin_fabs(b);
+        if (s[Sum] == Undecided) {
+            s[Sum] = filteredSign(a + b, size);
+        }
+        s[Diff] = filteredSign(a - b, size);
+        s[P3] = filteredSign(3 * a - b, 3 * size);
+        s[Q3] = filteredSign(3 * b - a, 3 * size);
+        for (int f : {Sum, Diff, P3, Q3}) {
+            stats.filtered += s[f] != Undecided;
+        }
+#endif
+        if (s[Sum] == Undecided) {
+            stats.exact++;
+            s[Sum] = sgn(p + q);
+        }
+        if (s[Diff] == Undecided || s[P3] == Undecided || s[Q3] == Undecided) {
+            const num d = p - q;
+            for (int f : {Diff, P3, Q3}) {
+                if (s[f] == Undecided) {
+                    stats.exact++;
+                    s[f] = sgn(f == Diff ? d : f == P3 ? (p << 1) + d : (q << 1) - d);
+                }
+            }
+        }
+    });
+    for (int c = 0; c < n; ++c) {
+        stats.refineChecks++;
+        const Candidate &k = cands[c];
+        int first = 0;
+        bool ok = true;
+        for (int i = 0; i < ncorners && ok; ++i) {
+            const int s = std::max(-1, std::min(1, k.sa * signs[i][k.a] + k.sb * signs[i][k.b]));
+            ok = s != 0 && (i == 0 || s == first);
+            first = s;
+        }
+        if (ok) {
+            return c;
+        }
+        stats.refineFailures++;
+    }
+    return -1;
+}
+
+// Sign emission (11.1), one step: false if no sign is known yet.
+bool sem(Emission &f) {
+    const int c = classify(f.e->head(), signCandidates, 4);
+    if (c < 0) {
+        return false;
+    }
+    f.emitSign(signTypes[c], *signInverses[c]);
+    return true;
+}
+
+// ceil(a / b) for b > 0.
+num ceildiv(const num &a, const num &b) {
+    const num q = a / b;
+    return a > 0 && q * b != a ? q + 1 : q;
+}
+
+// floor(a / b) for b > 0.
+num floordiv(const num &a, const num &b) {
+    const num q = a / b;
+    return a < 0 && q * b != a ? q - 1 : q;
+}
+
+// The longest run of 2 to k digits that can be emitted from l at once, or
+// Digits(0, 0) if there is none. Digits::to_mat(n, c) covers the points x in
+// [(c - 1) / 2^n, (c + 1) / 2^n] of [-1, 1], where a point p/q of [0, inf]
+// sits at x = (p - q) / (p + q), so n digits can go once the x of every
+// corner of l's image lies in one such interval. That is a few shifts and
+// comparisons per corner instead of a product and a refine() per digit.
+Digits digitBlock(const LFT &l, int k) {
+    if (l.isa<Vec>()) {
+        return Digits(0, 0);
+    }
+    num xs[4], ys[4];  // corner i is at xs[i] / ys[i], ys[i] > 0
+    int n = 0;
+    bool signed_ = true;
+    corners(l, [&](const num &p, const num &q) {
+        const int s = std::max(-1, std::min(1, sgn(p) + sgn(q)));
+        xs[n] = s * (p - q);
+        ys[n] = s * (p + q);
+        n++;
+        signed_ = signed_ && s != 0;
+    });
+    if (!signed_) {
+        return Digits(0, 0);
+    }
+    for (int len = k; len >= 2; --len) {
+        // the least c with every x 2^len <= c + 1 ...
+        num c = ceildiv(xs[0] << len, ys[0]) - 1;
+        for (int i = 1; i < n; ++i) {
+            c = std::max(c, ceildiv(xs[i] << len, ys[i]) - 1);
+        }
+        // ... but no less than 1 - 2^len, the least digit of len places;
+        // every x >= -1, so the rest still lie at or below c + 1 ...
+        c = std::max(c, num(1) - (num(1) << len));
+        // ... and must also have c - 1 <= every x 2^len.
+        bool fits = true;
+        for (int i = 0; i < n && fits; ++i) {
+            fits = (c - 1) * ys[i] <= xs[i] << len;
+        }
+        if (fits) {
+            return Digits(len, c);
+        }
+    }
+    return Digits(0, 0);
+}
+
+// Digit emission (11.2), one step: false if no digit is known yet.
+bool dem(Emission &f) {
+    const LFT &l = f.e->head();
+    if (f.k > 1 && f.j > 1) {
+        const Digits block = digitBlock(l, std::min(f.k, f.j));
+        if (block.d0 > 0) {
+            f.emitDigits(block);
+            return true;
+        }
+    }
+    const int c = classify(l, digitCandidates, 3);
+    if (c < 0) {
+        return false;
+    }
+    f.emitDigit(digitValues[c], *digitInverses[c]);
+    return true;
+}
+
+Emission run(Emission root, long *steps = nullptr);
+
+// the one digit dem of the tensor argument x, if run() has computed it in
+// the current arena before.
+const Expr *advanced(const Expr *x) {
+    const Arena *a = Arena::current();
+    if (!a) { return nullptr; }
+    const void *r = a->advanced.find(hashMix(0, (uintptr_t) x), [x](const void *k) { return k == x; });
+    return static_cast<const Expr *>(r);
+}
+
+void rememberAdvance(const Expr *x, const Expr *r) {
+    assert(x != nullptr);
+    if (Arena *a = Arena::current()) {
+        a->advanced.insert(hashMix(0, (uintptr_t) x), x, r);
+    }
+}
+
+// The one digit dem of a tensor argument of a tensor (11.4), run on a Pool
+// ahead of time. Only one side of a tensor is absorbed per step, and it is
+// usually the other side next, so run() starts this for the side it is not
+// absorbing; it depends only on the argument, so the result is what run()
+// would have computed itself. Whatever the task allocates goes to a child
+// of the evaluation's arena, and a frame joins its speculation before it
+// finishes, so nothing outlives the evaluation.
+struct Speculation {
+    Pool *pool;
+    const Expr *arg;
+    const Expr *result = nullptr;
+    std::shared_ptr<Pool::Task> task;
+
+    const Expr *join() {
+        pool->wait(*task);
+        return result;
+    }
+};
+
+// start advancing the argument y of f on the current pool, if there is
+// room and y is worth it. Not from deep inside other tasks, whose joins
+// would otherwise nest without bound (see Pool::nesting).
+void speculate(Emission &f, const Expr *y) {
+    static const int maxNesting = 8;
+    Pool *pool = Pool::current();
+    if (!pool || f.spec || Pool::nesting() >= maxNesting || !y->head().isa<Tensor>() || pool->pending() >= (size_t) pool->size() || advanced(y)) {
+        return;
+    }
+    Arena *arena = Arena::current() ? &Arena::current()->child() : nullptr;
+    const Strategy *strategy = Strategy::current();
+    std::shared_ptr<Speculation> s = std::make_shared<Speculation>();
+    Speculation *sp = s.get();
+    sp->pool = pool;
+    sp->arg = y;
+    sp->task = std::make_shared<Pool::Task>();
+    sp->task->fn = [sp, arena, strategy]() {
+        ArenaScope scope(arena);
+        StrategyScope absorbing(strategy);
+        const Emission r = run(Emission(sp->arg, 1, true));
+        sp->result = Uefp(r.d, r.e).to_expr();
+    };
+    f.spec = s;
+    Stats::get().speculated++;
+    pool->submit(sp->task);
+}
+
+// ===Rational folding===
+// A node whose arguments are all rationals is a rational itself, its LFT
+// applied to them, but run() only finds that out after emitting the sign
+// and trying for digits at every absorption on the way there. efold finds
+// such subgraphs up front and replaces each by a single Vec, which the
+// node above absorbs as one LFT: a tensor with one rational side becomes a
+// matrix over the other. The walk only follows literal cells, so it covers
+// what was built by hand (the server's queries, tadd(x, y) and friends)
+// and never forces or walks the cells of a series, however far those have
+// been forced.
+
+// x over its arguments as efold left them: the rational ones absorbed, the
+// rest in their own cells unless folding changed them.
+const Expr *foldNode(const Expr *x, const std::unordered_map<const Expr *, const Expr *> &folded) {
+    const LFT &l = x->head();
+    const int n = l.branch();
+    const ExprThunk *cells[2] = {nullptr, nullptr};
+    const Vec *values[2] = {nullptr, nullptr};
+    bool changed = false;
+    for (int i = 0; i < n; ++i) {
+        cells[i] = x->tailThunk(i + 1);
+        if (cells[i]->literal()) {
+            const Expr *a = folded.at(cells[i]->peek());
+            values[i] = a->head().dyn_cast<Vec>();
+            if (a != cells[i]->peek()) {
+                cells[i] = mk<ExprThunk>(ExprThunk::thunkify(a));
+                changed = true;
+            }
+        }
+    }
+    if (const Mat *m = l.dyn_cast<Mat>()) {
+        if (values[0]) {
+            const Vec v = dot1(*m, *values[0]);
+            return v == Vec(0, 0) ? x : mk<VecExpr>(v);
+        }
+        return changed ? mk<MatExpr>(*m, cells[0]) : x;
+    }
+    const Tensor &t = l.cast<Tensor>();
+    if (values[0] && values[1]) {
+        const Vec v = dot1(dot2(t, *values[1]), *values[0]);
+        return v == Vec(0, 0) ? x : mk<VecExpr>(v);
+    } else if (values[0]) {
+        return mk<MatExpr>(dot1(t, *values[0]), cells[1]);
+    } else if (values[1]) {
+        return mk<MatExpr>(dot2(t, *values[1]), cells[0]);
+    }
+    return changed ? mk<TensorExpr>(t, cells[0], cells[1]) : x;
+}
+
+// e with its rational subgraphs folded, see above. The walk keeps its own
+// stack, as run() does, and visits a shared node once.
+const Expr *efold(const Expr *e) {
+    bool literal = false;
+    for (int i = 1; i <= e->head().branch(); ++i) {
+        literal = literal || e->tailThunk(i)->literal();
+    }
+    if (!literal) {
+        return e;
+    }
+    std::unordered_map<const Expr *, const Expr *> folded;
+    std::vector<const Expr *> stack{e};
+    while (!stack.empty()) {
+        const Expr *x = stack.back();
+        if (folded.count(x)) {
+            stack.pop_back();
+            continue;
+        }
+        bool ready = true;
+        for (int i = 1; i <= x->head().branch(); ++i) {
+            const ExprThunk *c = x->tailThunk(i);
+            if (c->literal() && !folded.count(c->peek())) {
+                stack.push_back(c->peek());
+                ready = false;
+            }
+        }
+        if (ready) {
+            stack.pop_back();
+            const Expr *out = x->head().isa<Vec>() ? x : foldNode(x, folded);
+            Stats::get().folded += out != x;
+            folded[x] = out;
+        }
+    }
+    return folded.at(e);
+}
+
+// Runs root to completion. A frame that can emit nothing absorbs its
+// arguments (11.4): a side the strategy declines is wrapped in the identity,
+// a tensor argument of a tensor is first pushed as a one digit dem frame (or
+// taken from its speculation, or from an earlier advance of the same node),
+// and anything else is taken as is.
+//
+// With `steps`, each turn of the loop takes one of them, and once they run
+// out run() returns the bottom frame as far as it got, for a later run() to
+// continue. The work of a cell forced on the way is not counted.
+Emission run(Emission root, long *steps) {
+    if (!root.signed_ && root.next == 0) {
+        root.e = efold(root.e);
+    }
+    std::vector<Emission> stack{root};
+    for (;;) {
+        if (steps && (*steps)-- <= 0) {
+            for (Emission &f : stack) {
+                if (f.spec) { f.spec->join(); }
+            }
+            Emission out = stack.front();
+            out.next = out.side = 0;
+            out.args[0] = out.args[1] = nullptr;
+            out.spec = nullptr;
+            return out;
+        }
+        Emission &f = stack.back();
+        if (f.next == 0) {
+            if (f.done()) {
+                if (f.spec) {
+                    f.spec->join();
+                }
+                if (stack.size() == 1) {
+                    return f;
+                }
+                const Expr *out = Uefp(f.d, f.e).to_expr();
+                rememberAdvance(f.from, out);
+                TRACE(Pop, 0, f.depth, out->head());
+                stack.pop_back();
+                stack.back().absorbed(out);
+                continue;
+            }
+            if (f.signed_ ? dem(f) : sem(f)) {
+                continue;
+            }
+            f.next = 1;
+            f.side = decision(f.e);
+        }
+        const LFT &l = f.e->head();
+        if (f.next > l.branch()) {
+            f.e = l.app(f.args);
+            f.next = 0;
+            TRACE(App, 0, f.depth, f.e->head());
+            continue;
+        }
+        const Expr *x = f.e->tail(f.next);
+        Stats &stats = Stats::get();
+        if (f.next != f.side) {
+            stats.declined[f.next - 1]++;
+            TRACE(Decline, f.next, f.depth, x->head());
+            f.absorbed(mk<MatExpr>(Mat::identity(), ExprThunk::thunkify(x)));
+        } else if (l.isa<Tensor>() && x->head().isa<Tensor>()) {
+            stats.absorbed[f.next - 1]++;
+            stats.strategyTerms[Strategy::current()->id]++;
+            const Expr *y = f.e->tail(3 - f.next);
+            const Expr *r = nullptr;
+            if (f.spec && f.spec->arg == x) {
+                r = f.spec->join();
+                f.spec = nullptr;
+                stats.speculationsUsed++;
+                rememberAdvance(x, r);
+            } else {
+                if (f.spec && f.spec->arg != y) {
+                    f.spec->join();  // stale
+                    f.spec = nullptr;
+                }
+                if ((r = advanced(x))) {
+                    stats.reused++;
+                }
+            }
+            if (r) {
+                TRACE(Absorb, f.next, f.depth, x->head());
+                f.absorbed(r);
+                continue;
+            }
+            if (y != x) {
+                speculate(f, y);  // else the frame below is advancing it
+            }
+            TRACE(Push, f.next, f.depth, x->head());
+            Emission sub(x, 1, true);
+            sub.depth = f.depth + 1;
+            sub.from = x;
+            stack.push_back(sub);  // invalidates f
+        } else {
+            stats.absorbed[f.next - 1]++;
+            stats.strategyTerms[Strategy::current()->id]++;
+            TRACE(Absorb, f.next, f.depth, x->head());
+            f.absorbed(x);
+        }
+    }
+}
+
+// k > 1 lets each step emit up to k digits at once, see digitBlock.
+Sefp sem(const Expr *e, int i, int k = 1) {
+    Emission root(e, i, false);
+    root.k = k;
+    const Emission f = run(root);
+    return Sefp(f.sign, Uefp(f.d, f.e));
+}
+
+Uefp dem(Digits d, const Expr *e, int j, int k = 1) {
+    Emission root(e, j, true);
+    root.d = d;
+    root.k = k;
+    const Emission f = run(root);
+    return Uefp(f.d, f.e);
+}
+
+std::string mshow(Mat m);
+
+std::string sshow(deque<int> numbers);
+
+std::deque<int> scientific(Mat mat, int i);
+
+std::deque<int> mantissa(int i, int n, Mat mat);
+
+std::string eshow(const Expr *e, int i, int k = 1) {
+    ArenaScope scope(Arena::evaluation());
+    return mshow(sem(e, i, k).to_mat());
+}
+
+// The digits of an expression, produced on demand. The stream keeps the
+// residual expression and the digits emitted so far in an Emission, so
+// more(k) continues exactly where the last call stopped: asking for n digits
+// in steps costs the same as asking for them at once.
+//
+// Everything the stream allocates lives in its own arena. A stream over a
+// graph it built itself also owns that graph, and keeps its memory bounded:
+// once the arena holds more than the budget, compact() copies the residual
+// to the spare arena and releases the rest, consumed terms of the series,
+// superseded heads and intermediate results alike. Only the residual's
+// coefficients and the digits themselves grow with the digits emitted.
+struct DigitStream {
+    // k is the most digits one step may emit, see digitBlock. The stream
+    // keeps everything it allocates until it is destroyed, since e's cells
+    // memoize into it.
+    explicit DigitStream(const Expr *e, int k = 1) : state(e, 0, false) {
+        state.k = k;
+        arenas[0].retain();
+        arenas[1].retain();
+    }
+
+    // the digits of build(), which is called with the stream's arena current,
+    // so the stream owns the whole graph and may compact it.
+    explicit DigitStream(const std::function<const Expr *()> &build, int k = 1) : DigitStream(nullptr, k) {
+        ArenaScope scope(arenas[0]);
+        state.e = build();
+        owned = true;
+    }
+
+    DigitStream(const DigitStream &) = delete;
+
+    DigitStream &operator=(const DigitStream &) = delete;
+
+    ~DigitStream() {
+        arenas[0].release();
+        arenas[1].release();
+    }
+
+    // emit k more digits, after the sign if that is not known yet. An owned
+    // stream runs in steps of `chunk` digits and checks the budget after each.
+    void more(int k) {
+        do {
+            const int step = owned ? std::min(k, chunk) : k;
+            {
+                ArenaScope scope(arenas[cur]);
+                state.j = step;
+                state = run(state);
+            }
+            k -= step;
+            if (owned && arenas[cur].bytesInUse() > limit) {
+                compact();
+            }
+        } while (k > 0 && !exact());
+    }
+
+    // bytes of nodes an owned stream may accumulate before it compacts. A
+    // residual that is itself larger raises the threshold to twice its size.
+    void setMemoryBudget(size_t bytes) {
+        budget = bytes;
+        limit = bytes;
+    }
+
+    // copy the residual expression, which is all later digits depend on, to
+    // the spare arena and reset the current one.
+    void compact() {
+        assert(owned);
+        state.spec = nullptr;  // joined before run() returned
+        Arena &from = arenas[cur];
+        Arena &to = arenas[1 - cur];
+        {
+            ArenaScope scope(to);
+            Relocation relocate(from);
+            state.e = relocate(state.e);
+        }
+        from.reset();
+        cur = 1 - cur;
+        limit = std::max(budget, 2 * to.bytesInUse());
+        Stats::get().compactions++;
+    }
+
+    size_t bytesInUse() const { return arenas[cur].bytesInUse(); }
+
+    // write the digits so far and the residual expression to path (see
+    // Checkpoints), replacing it atomically. False if it could not be
+    // written, or the residual has a cell with no checkpoint form.
+    bool save(const char *path) const;
+
+    // the stream a checkpoint was saved from, as of then, or nullptr if the
+    // file cannot be read. The file is mapped rather than read, and the
+    // stream owns the graph it rebuilds.
+    static std::unique_ptr<DigitStream> load(const char *path);
+
+    // digits emitted so far.
+    int digits() const { return state.d.d0; }
+
+    // whether the sign has been emitted.
+    bool signedYet() const { return state.signed_; }
+
+    // whether the value is known exactly, so more() has nothing left to add.
+    bool exact() const { return state.e->head().isa<Vec>(); }
+
+    Mat to_mat() const { return Sefp(state.sign, Uefp(state.d, state.e)).to_mat(); }
+
+    std::string show() const { return mshow(to_mat()); }
+
+private:
+    static constexpr int chunk = 64;
+
+    Arena arenas[2];
+    int cur = 0;  // the arena in use, the other is empty
+    bool owned = false;
+    size_t budget = 8 << 20;
+    size_t limit = budget;
+    Emission state;
+};
+
+// ===Precision-directed evaluation===
+// sem and dem pull digits from the top: to emit, a tensor absorbs whichever
+// argument the strategy picks, however little that argument matters to the
+// result. eapprox works down from an error bound instead. The arithmetic
+// nodes the caller built (tadd, tsub, tmul and tdiv) form a tree of
+// intervals, and everything below them is a leaf, evaluated with sem to as
+// many digits as its interval needs. A node's interval follows from its
+// arguments' through its tensor. How fast it widens with each argument's
+// interval then says how narrow that argument must be, so every operand is
+// refined only as far as its share of the error: the small term of a sum
+// takes few digits, whatever the large one needs. The builders' own
+// arithmetic counts too; epi is a tdiv of two series, which then never meet
+// in a tensor.
+
+// log2 |x|, -inf for 0.
+double log2abs(const num &x) {
+    if (x == 0) { return -__builtin_inf(); }
+    const int b = bitLength(x);
+    return b + __builtin_log2(__builtin_fabs(x.scaled(b)));
+}
+
+// a closed interval [lo, hi], both ends with positive denominators, or the
+// whole line if unbounded.
+struct Interval {
+    Vec lo = Vec(0, 1), hi = Vec(0, 1);
+    bool bounded = false;
+
+    Interval() = default;
+
+    // the image of [0, inf] under the columns of m, or of a tensor's
+    // corners under every pair of arguments in [0, inf]: the value is an
+    // average of the corners with weights of one sign, over denominators
+    // of one sign too if the corners' are, and lies between the least and
+    // greatest of them.
+    Interval(const Vec *corners, int n) {
+        int sign = sgn(corners[0].v1);
+        for (int i = 0; i < n; ++i) {
+            if (sign == 0 || sgn(corners[i].v1) != sign) { return; }
+        }
+        auto positive = [sign](const Vec &v) { return sign > 0 ? v : Vec(-v.v0, -v.v1); };
+        lo = hi = positive(corners[0]);
+        for (int i = 1; i < n; ++i) {
+            const Vec v = positive(corners[i]);
+            if (v < lo) { lo = v; }
+            if (hi < v) { hi = v; }
+        }
+        lo = lo.scale();
+        hi = hi.scale();
+        bounded = true;
+    }
+
+    static Interval of(const Mat &m) {
+        const Vec cs[] = {m.v0(), m.v1()};
+        return Interval(cs, 2);
+    }
+
+    // log2 of hi - lo: -inf for a point, inf if unbounded.
+    double width() const {
+        if (!bounded) { return __builtin_inf(); }
+        return log2abs(hi.v0 * lo.v1 - lo.v0 * hi.v1) - log2abs(hi.v1) - log2abs(lo.v1);
+    }
+
+    bool hasZero() const { return !bounded || (lo.v0.sign() <= 0 && hi.v0.sign() >= 0); }
+
+    // the matrix mapping [0, inf] onto the interval.
+    Mat to_mat() const { return Mat(hi, lo); }
+
+    // whether hi - lo is at most 2^-bits, or 2^-bits of the least magnitude
+    // in the interval if relative; exactly.
+    bool within(int bits, bool relative) const {
+        if (!bounded || (relative && hasZero())) { return false; }
+        num w = hi.v0 * lo.v1 - lo.v0 * hi.v1;
+        num bound = relative ? std::min(abs(lo.v0) * hi.v1, abs(hi.v0) * lo.v1) : hi.v1 * lo.v1;
+        if (bits >= 0) { w = w << bits; }
+        else { bound = bound << -bits; }
+        return w <= bound;
+    }
+};
+
+// log2 |a - b| for points with positive denominators.
+double log2dist(const Vec &a, const Vec &b) {
+    return log2abs(a.v0 * b.v1 - b.v0 * a.v1) - log2abs(a.v1) - log2abs(b.v1);
+}
+
+// one eapprox: an interval per node, refined in place, so that a node two
+// parents share is refined once, as far as the stricter of them asks.
+struct Approximation {
+    struct Node {
+        const Tensor *op = nullptr;  // for an arithmetic node
+        Node *args[2] = {nullptr, nullptr};
+        Emission state = Emission(nullptr, 0, false);  // for a leaf
+        Interval box;
+    };
+
+    // the node for e; arithmetic nodes get nodes for their arguments too.
+    Node &node(const Expr *e) {
+        std::unique_ptr<Node> &n = nodes[e];
+        if (n) { return *n; }
+        n.reset(new Node());
+        Node &out = *n;
+        const Tensor *t = e->head().dyn_cast<Tensor>();
+        for (const Tensor *op : {&tadd, &tsub, &tmul, &tdiv}) {
+            if (t && *t == *op) { out.op = op; }
+        }
+        if (out.op) {
+            out.args[0] = &node(e->tail(1));
+            out.args[1] = &node(e->tail(2));
+        } else if (const Vec *v = e->head().dyn_cast<Vec>()) {
+            out.box = Interval(v, 1);
+        } else {
+            out.state = Emission(e, 0, false);
+        }
+        return out;
+    }
+
+    // narrow n's interval to a width of at most 2^target, as far as the
+    // estimates go; see eapprox.
+    void refine(Node &n, double target) {
+        if (n.op) {
+            refineNode(n, target);
+            return;
+        }
+        while (n.state.e && (!n.box.bounded || n.box.width() > target) && !n.state.e->head().isa<Vec>()) {
+            // a digit roughly halves the interval, once it is bounded.
+            const double more = n.box.bounded ? n.box.width() - target : 0;
+            n.state.j = n.state.signed_ ? std::max(1, std::min(1 << 20, (int) more + 1)) : 0;
+            n.state = run(n.state);
+            n.box = Interval::of(Sefp(n.state.sign, Uefp(n.state.d, n.state.e)).to_mat());
+        }
+    }
+
+private:
+    // the tensor of n, with its arguments' intervals absorbed.
+    static Tensor compose(const Node &n) {
+        return n.op->left(n.args[0]->box.to_mat()).right(n.args[1]->box.to_mat()).scale();
+    }
+
+    void refineNode(Node &n, double target) {
+        static const double inf = __builtin_inf();
+        for (;;) {
+            Node &x = *n.args[0], &y = *n.args[1];
+            if (!x.box.bounded || !y.box.bounded) {
+                refine(x, inf);
+                refine(y, inf);
+            }
+            const Tensor t = compose(n);
+            const Vec cs[] = {t.ms[0].v0(), t.ms[0].v1(), t.ms[1].v0(), t.ms[1].v1()};
+            n.box = Interval(cs, 4);
+            if (n.box.bounded && n.box.width() <= target) {
+                return;
+            }
+            if (!n.box.bounded) {
+                // a pole in reach, like a divisor whose interval holds 0.
+                refine(x, x.box.width() - 1);
+                refine(y, y.box.width() - 1);
+                continue;
+            }
+            // how far the result spreads as each argument moves with the
+            // other fixed. n's width is at most the sum, so a side whose
+            // spread is within half the target needs nothing; another gets
+            // a width that brings its spread there, at the slope its
+            // interval shows now, and at least half the width it has.
+            Vec c[2][2] = {{cs[0], cs[1]}, {cs[2], cs[3]}};
+            for (auto &row : c) {
+                for (Vec &v : row) {
+                    v = v.v1 < 0 ? Vec(-v.v0, -v.v1) : v;
+                }
+            }
+            const double spread[2] = {
+                    std::max(log2dist(c[0][0], c[1][0]), log2dist(c[0][1], c[1][1])),
+                    std::max(log2dist(c[0][0], c[0][1]), log2dist(c[1][0], c[1][1]))};
+            for (int side = 0; side < 2; ++side) {
+                Node &a = *n.args[side];
+                const double w = a.box.width();
+                if (spread[side] > target - 1 && w > -inf) {
+                    refine(a, std::min(target - 1 - (spread[side] - w), w - 1));
+                }
+            }
+        }
+    }
+
+    std::unordered_map<const Expr *, std::unique_ptr<Node>> nodes;
+};
+
+// an interval around e's value no wider than 2^-bits, or than 2^-bits of the
+// value's magnitude if relative, as the matrix mapping [0, inf] onto it. A
+// relative bound has to separate the value from 0 first, so it does not
+// return for a value that is 0.
+Mat eapprox(const Expr *e, int bits, bool relative = false) {
+    Approximation a;
+    Approximation::Node &root = a.node(e);
+    double target = -bits;
+    for (;;) {
+        if (relative && root.box.hasZero()) {
+            a.refine(root, root.box.width() - 1);
+            continue;
+        }
+        const double scale = relative ? std::min(log2abs(root.box.lo.v0) - log2abs(root.box.lo.v1),
+                                                 log2abs(root.box.hi.v0) - log2abs(root.box.hi.v1)) : 0;
+        a.refine(root, target + scale);
+        if (root.box.within(bits, relative)) {
+            return root.box.to_mat();
+        }
+        target -= 1;  // the estimates fell short
+    }
+}
+
+std::string eshowWithin(const Expr *e, int bits, bool relative = false) {
+    ArenaScope scope(Arena::evaluation());
+    return mshow(eapprox(e, bits, relative));
+}
+
+std::string mshow(Mat m) {
+    const num d = m.determinant();
+    const Vec v = m.v0().scale();
+    const num p = v.v1 < 0 ? -v.v0 : v.v0;
+    const num q = v.v1 < 0 ? -v.v1 : v.v1;
+    if (d == 0) {
+        if (q == 1) {
+            return to_string(p);
+        } else {
+            return to_string(p) + "/" + to_string(q);
+        }
+    } else {
+        return sshow(scientific(m, 0));
+    }
+}
+
+num powi(num base, int exp) {
+    num ans = 1;
+    for (int i = 0; i < exp; ++i) {
+        ans *= base;
+    }
+    return ans;
+}
+
+std::tuple<int, int, num> normalize(int e, int l, num v) {
+    while (l > 0 && abs(v) < powi(10, l - 1)) {
+        e--;
+        l--;
+    }
+    return std::make_tuple(e, l, v);
+}
+
+std::string sshow(deque<int> numbers) {
+    if (numbers.size() == 0) {
+        return "unbounded";
+    }
+    const int e = numbers[0];
+
+    num f = 0;
+    for (int i = 1; i < (int) numbers.size(); i++) {
+        f = f * 10 + numbers[i];
+    }
+
+    int h, l;
+    num v;
+    std::tie(h, l, v) = normalize(e, numbers.size() - 1, f);
+
+    std::string out = "";
+    if (v < 0) {
+        out += "-";
+    }
+    if (v == 0) {
+        out += "0";
+    } else {
+        out += "0." + to_string(abs(v));
+    }
+    out += "e";
+    out += std::to_string(h);
+    return out;
+}
+
+// the thesis recurses once per power of ten, and mantissa once per
+// candidate digit; both are loops here.
+std::deque<int> scientific(Mat m, int n) {
+    for (;; ++n) {
+        if (m.inverse().dot(Vec(1, 0)).refine()) {
+            return {};
+        } else if (szer.inverse().dot(m).refine()) {
+            deque<int> ss = mantissa(-9, 9, m);
+            ss.push_front(n);
+            return ss;
+        }
+        m = Mat(1, 0, 0, 10).dot(m);
+    }
+}
+
+std::deque<int> mantissa(int i, int n, Mat mat) {
+    std::deque<int> ss;
+    for (;;) {
+        Mat d(i + 1, 10, i - 1, 10);
+        if (d.inverse().dot(mat).refine()) {  // c i
+            Mat e(10, 0, -i, 1);
+            mat = e.dot(mat);
+            ss.push_back(i);
+            i = -9;
+            n = 9;
+        } else if (i < n) {
+            i++;
+        } else {
+            return ss;
+        }
+    }
+}
+
+// f(lo) f(lo + 1) ... f(hi - 1), by binary splitting: the halves are
+// multiplied as a balanced tree, so the two factors of each product have
+// about the same size and the coefficients grow as slowly as they can.
+template<typename F>
+Mat eproduct(const F &f, int lo, int hi) {
+    assert(lo < hi);
+    if (hi - lo == 1) {
+        return f(lo);
+    }
+    const int mid = lo + (hi - lo) / 2;
+    return eproduct(f, lo, mid).dot(eproduct(f, mid, hi)).scale();
+}
+
+// The series the builders below iterate, as named function objects rather
+// than lambdas so that a checkpoint can say which one a cell is computing.
+enum class Series : uint8_t {
+    E, Pi, Tan, Arctan
+};
+
+template<typename F, typename = void>
+struct Named : std::false_type {};
+
+template<typename F>
+struct Named<F, std::void_t<decltype(F::series)>> : std::true_type {};
+
+// f(n) applied to the rational x, so that a series in x is a series of
+// matrices. See eiteratex.
+template<typename F>
+struct AtVec {
+    F f;
+    Vec x;
+
+    Mat operator()(int n) const { return dot1(f(n), x); }
+};
+
+// a series as a checkpoint names it: which one, and its x if it is an AtVec.
+template<typename F>
+bool saveSeries(CheckpointWriter &w, const F &f) {
+    if constexpr (Named<F>::value) {
+        w.u8((uint8_t) F::series);
+        w.u8(0);
+        return true;
+    } else {
+        return false;
+    }
+}
+
+template<typename F>
+bool saveSeries(CheckpointWriter &w, const AtVec<F> &f) {
+    if constexpr (Named<F>::value) {
+        w.u8((uint8_t) F::series);
+        w.u8(1);
+        w.vec(f.x);
+        return true;
+    } else {
+        return false;
+    }
+}
+
+// what each closure record starts with.
+enum class Closure : uint8_t {
+    Iterate, IterateX, Newton, Blocks, NewtonX
+};
+
+template<typename F>
+const Expr *eiterate(F f, int n, int block = 1);
+
+template<typename F>
+const Expr *eiteratex(F f, int n, const Expr *x, int block = 1);
+
+// the cells eiterate and eiteratex leave for the rest of their expansion.
+template<typename F>
+struct Iterate {
+    F f;
+    int n;
+    int block;
+
+    const Expr *operator()() const { return eiterate(f, n, block); }
+
+    bool save(CheckpointWriter &w) const {
+        w.u8((uint8_t) Closure::Iterate);
+        if (!saveSeries(w, f)) { return false; }
+        w.i32(n);
+        w.i32(block);
+        return true;
+    }
+};
+
+template<typename F>
+struct IterateX {
+    F f;
+    int n;
+
+    const Expr *operator()(const Expr *x) const { return eiteratex(f, n, x); }
+
+    bool save(CheckpointWriter &w) const {
+        w.u8((uint8_t) Closure::IterateX);
+        if (!saveSeries(w, f)) { return false; }
+        w.i32(n);
+        return true;
+    }
+};
+
+// f(n) f(n + 1) ..., with each run of `block` terms collapsed into a single
+// matrix, so the engine absorbs one matrix per block instead of per term.
+// The generator is a template parameter so that each tail closure holds f
+// itself rather than another heap allocated std::function.
+template<typename F>
+const Expr *eiterate(F f, int n, int block) {
+    // this needs to be lazy, will instantly blow up
+    return mk<MatExpr>(eproduct(f, n, n + block), delay(Iterate<F>{f, n + block, block}));
+}
+
+// f(n)(x, f(n + 1)(x, ...)). Terms only collapse into blocks when x is a
+// rational: each term is then a matrix, while with an x still to be computed
+// a product of terms is not an LFT.
+template<typename F>
+const Expr *eiteratex(F f, int n, const Expr *x, int block) {
+    if (block > 1) {
+        if (const Vec *v = x->head().dyn_cast<Vec>()) {
+            return eiterate(AtVec<F>{f, *v}, n, block);
+        }
+    }
+    return mk<TensorExpr>(f(n), mk<ExprThunk>(x), delay(IterateX<F>{f, n + 1}, x));
+}
+
+// Newton's step x -> (x + a/x) / 2 for sqrt(a), a = p/q, as nested
+// intervals: from above the root x stays above it and a/x below, and each
+// step squares the relative width of [a/x, x]. A node's head takes [0, inf]
+// to the next interval inside the previous one, so the heads of the chain
+// multiply out to ever narrower enclosures of the root, each fixing twice
+// the digits of the one before. The coefficients of the heads grow at the
+// same rate, see eblocks.
+struct NewtonSqrt {
+    num p, q;
+    num xp, xq;  // the upper end x = xp/xq
+
+    Mat interval() const { return Mat(Vec(xp, xq), Vec(p * xq, q * xp)).scale(); }
+
+    NewtonSqrt next() const {
+        const Vec x = Vec(xp * xp * q + p * xq * xq, 2 * xp * xq * q).scale();
+        return NewtonSqrt{p, q, x.v0, x.v1};
+    }
+
+    const Expr *operator()() const {
+        const NewtonSqrt n = next();
+        return mk<MatExpr>(interval().inverse().dot(n.interval()).scale(), delay(n));
+    }
+
+    bool save(CheckpointWriter &w) const {
+        w.u8((uint8_t) Closure::Newton);
+        w.number(p);
+        w.number(q);
+        w.number(xp);
+        w.number(xq);
+        return true;
+    }
+};
+
+// the next n digits of x, up to k per step, its sign first unless signed_:
+// m becomes the matrix they make, and the residual is returned. A k well
+// below n is cheaper, as each step then absorbs only what its own digits
+// need. This is an evaluation inside whichever thunk asks for it, so it runs
+// without the pool: the thunk may itself be running on a worker, or be what
+// other threads wait for (see ExprThunk).
+const Expr *emitDigits(const Expr *x, int n, int k, bool signed_, Mat &m) {
+    PoolScope serial(nullptr);
+    if (signed_) {
+        const Uefp u = dem(Digits(0, 0), x, n, k);
+        m = u.digits.to_mat();
+        return u.e;
+    }
+    const Sefp s = sem(x, n, k);
+    m = s.sign().dot(s.uefp.digits.to_mat()).scale();
+    return s.uefp.e;
+}
+
+// the digits the engine emits for x, `block` at a time: each head is the
+// matrix of one run of digits (the sign and digits in the first), each tail
+// the residual. The same number as x, but absorbing a head takes on the
+// coefficients of at most `block` digits whatever x's own heads hold.
+struct Blocks {
+    int block;
+    bool signed_;  // the sign has been emitted
+
+    const Expr *operator()(const Expr *x) const {
+        Mat m = Mat::identity();
+        const Expr *rest = emitDigits(x, block, block, signed_, m);
+        if (rest->head().isa<Vec>()) {
+            return mk<MatExpr>(m, ExprThunk::thunkify(rest));
+        }
+        return mk<MatExpr>(m, delay(Blocks{block, true}, rest));
+    }
+
+    bool save(CheckpointWriter &w) const {
+        w.u8((uint8_t) Closure::Blocks);
+        w.i32(block);
+        w.u8(signed_);
+        return true;
+    }
+};
+
+const Expr *eblocks(const Expr *x, int block) {
+    return mk<MatExpr>(Mat::identity(), delay(Blocks{block, false}, x));
+}
+
+// Each step of NewtonSqrt doubles the digits fixed with ever larger
+// coefficients, and a tensor that took Newton's heads directly would carry
+// those into every digit it emits after. Through eblocks it sees
+// `newtonBlock` digits per head.
+static const int newtonBlock = 64;
+
+// the greatest s with s * s <= n, n >= 0, by Newton's step on integers.
+// One step from any seed > 0 lands at or above s, and the steps after go
+// down to it; from a seed within a relative 2^-k of the root, each of them
+// doubles k.
+num floorSqrt(const num &n, const num &seed = 0) {
+    if (n == 0) {
+        return 0;
+    }
+    num x = seed > 0 ? seed : num(1) << ((bitLength(n) + 1) / 2);
+    x = (x + n / x) >> 1;
+    for (;;) {
+        const num y = (x + n / x) >> 1;
+        if (y >= x) {
+            return x;
+        }
+        x = y;
+    }
+}
+
+// the least s with s * s >= n >= 0.
+num ceilSqrt(const num &n, const num &seed = 0) {
+    const num x = floorSqrt(n, seed);
+    return x * x < n ? x + 1 : x;
+}
+
+// p/q, p >= 0 < q. Newton starts from ceilSqrt(pq) / q, within a relative
+// 1/sqrt(pq) above the root: from further off its first steps only halve the
+// error, while the coefficients double all the same.
+const Expr *esqrtrat(num p, num q) {
+    const num s = ceilSqrt(p * q);
+    if (s * s == p * q) {
+        return mk<VecExpr>(Vec(s, q).scale());
+    }
+    const NewtonSqrt x0{p, q, s, q};
+    return eblocks(mk<MatExpr>(x0.interval(), delay(x0)), newtonBlock);
+}
+
+// integers lo <= e^(a / 2^s) 2^bits <= hi, for a >= 0: Taylor's series at
+// a / 2^(s + j), small enough that it needs about sqrt(bits) terms, then j
+// squarings. Every step rounds away from the value on its side, so the
+// bounds hold however few guard bits the working precision p carries.
+void expBounds(const num &a, int s, int bits, num &lo, num &hi) {
+    assert(a >= 0);
+    const int r = std::max(2, (int) __builtin_sqrt((double) bits) / 2);
+    const int j = std::max(0, bitLength(a) - s + r);
+    const int p = bits + j + 32;
+    const num one = num(1) << p;
+    num ulo, uhi;
+    if (p >= s + j) {
+        ulo = uhi = a << (p - s - j);
+    } else {
+        ulo = a >> (s + j - p);
+        uhi = ceildiv(a, num(1) << (s + j - p));
+    }
+    num tlo = one, thi = one, slo = one, shi = one;
+    for (int n = 1; thi > 1; ++n) {
+        tlo = (tlo * ulo >> p) / n;
+        thi = ceildiv(ceildiv(thi * uhi, one), num(n));
+        slo += tlo;
+        shi += thi;
+    }
+    // the terms after the last are at most u / (1 - u) <= 1 times it.
+    shi += 1;
+    for (int i = 0; i < j; ++i) {
+        slo = slo * slo >> p;
+        shi = ceildiv(shi * shi, one);
+    }
+    lo = slo >> (p - bits);
+    hi = ceildiv(shi, num(1) << (p - bits));
+}
+
+// v to `bits` bits after the point, rounded down or up, for v with a
+// positive denominator.
+Vec floorAt(const Vec &v, int bits) { return Vec(floordiv(v.v0 << bits, v.v1), num(1) << bits).scale(); }
+
+Vec ceilAt(const Vec &v, int bits) { return Vec(ceildiv(v.v0 << bits, v.v1), num(1) << bits).scale(); }
+
+// The functions NewtonX computes, as a checkpoint names them. Each step
+// takes an interval x lies in, the interval `at` f(x) was known to lie in
+// (unbounded at first), and the bits x is known to, and gives an interval
+// around f(x) about that narrow, or false if x is not yet narrow enough to
+// say anything.
+enum class Step : uint8_t {
+    Sqrt, Log, Exp, LogNeg
+};
+
+// sqrt x, with x < 0 taken as 0: Newton's step on integers at both ends,
+// started from the end of the interval before.
+struct SqrtStep {
+    static const Step step = Step::Sqrt;
+
+    bool operator()(const Interval &x, const Interval &at, int bits, Interval &out) const {
+        if (!x.bounded) {
+            return false;
+        }
+        const int scale = x.hi.v0 > 0 ? (int) (log2abs(x.hi.v0) - log2abs(x.hi.v1)) / 2 : 0;
+        const int b = std::max(1, bits + 16 - scale);
+        const num seed = at.bounded ? ceildiv(at.hi.v0 << b, at.hi.v1) : num(0);
+        const num lo = x.lo.v0 > 0 ? floorSqrt(floordiv(x.lo.v0 << 2 * b, x.lo.v1), seed) : num(0);
+        const num hi = x.hi.v0 > 0 ? ceilSqrt(ceildiv(x.hi.v0 << 2 * b, x.hi.v1), seed) : num(0);
+        out.lo = Vec(lo, num(1) << b).scale();
+        out.hi = Vec(hi, num(1) << b).scale();
+        out.bounded = true;
+        return true;
+    }
+};
+
+// log x for x > 0 by Newton's method on exp: from y near log x, t = x e^-y
+// is near 1 and log x = y + log t, with 1 - 1/t <= log t <= t - 1. Both
+// bounds are within (t - 1)^2 of log t, so when y is within w of log x the
+// enclosure is about w^2 wide. y is the middle of the enclosure before, or
+// at first the log of a double.
+//
+// The sign of log x is not known up front and a tail has to lie in
+// [0, inf], so a chain takes one part of it: max(log x, 0) for sign 1,
+// max(-log x, 0) for sign -1, and `at` encloses that part. Once x is known
+// to be <= 0 there is nothing to refine towards, and the step stops the
+// program rather than take digits of x forever.
+template<int sign>
+struct LogPart {
+    static const Step step = sign > 0 ? Step::Log : Step::LogNeg;
+
+    bool operator()(const Interval &x, const Interval &at, int bits, Interval &out) const {
+        if (x.bounded && x.hi.v0 <= 0) {
+            cerr << "elogpos: the argument is not positive\n";
+            exit(1);
+        }
+        if (!x.bounded || x.lo.v0 <= 0) {
+            return false;
+        }
+        int s = 30;
+        num a;
+        if (at.bounded) {
+            s = bits / 2 + 16;
+            a = sign * floordiv((at.lo.v0 * at.hi.v1 + at.hi.v0 * at.lo.v1) << s, 2 * at.lo.v1 * at.hi.v1);
+        } else {
+            const double y = (log2abs(x.lo.v0) - log2abs(x.lo.v1)) * __builtin_log(2.0);
+            a = num((ll) __builtin_llround(y * (1 << s)));
+        }
+        const int w = bits + 16;
+        num elo, ehi;
+        expBounds(abs(a), s, w, elo, ehi);
+        // t's ends, with e^-y = 2^w / e for y > 0 and e / 2^w otherwise.
+        const Vec tlo = a > 0 ? Vec(x.lo.v0 << w, x.lo.v1 * ehi) : Vec(x.lo.v0 * elo, x.lo.v1 << w);
+        const Vec thi = a > 0 ? Vec(x.hi.v0 << w, x.hi.v1 * elo) : Vec(x.hi.v0 * ehi, x.hi.v1 << w);
+        const Vec lo = floorAt(Vec(a * tlo.v0 + ((tlo.v0 - tlo.v1) << s), tlo.v0 << s), w);
+        const Vec hi = ceilAt(Vec(a * thi.v1 + ((thi.v0 - thi.v1) << s), thi.v1 << s), w);
+        const Vec zero(0, 1);
+        out.lo = sign > 0 ? (lo.v0 > 0 ? lo : zero) : (hi.v0 < 0 ? Vec(-hi.v0, hi.v1) : zero);
+        out.hi = sign > 0 ? (hi.v0 > 0 ? hi : zero) : (lo.v0 < 0 ? Vec(-lo.v0, lo.v1) : zero);
+        out.bounded = true;
+        return true;
+    }
+};
+
+using LogStep = LogPart<1>;
+using LogNegStep = LogPart<-1>;
+
+// exp x: each end of x rounded outward to a dyadic, through expBounds, with
+// e^-z = 1 / e^z for the negative ones.
+struct ExpStep {
+    static const Step step = Step::Exp;
+
+    bool operator()(const Interval &x, const Interval &at, int bits, Interval &out) const {
+        if (!x.bounded) {
+            return false;
+        }
+        const int w = bits + 16;
+        const num zlo = floordiv(x.lo.v0 << w, x.lo.v1), zhi = ceildiv(x.hi.v0 << w, x.hi.v1);
+        num lo, hi;
+        expBounds(abs(zlo), w, w, lo, hi);
+        out.lo = zlo >= 0 ? Vec(lo, num(1) << w) : Vec(num(1) << w, hi);
+        expBounds(abs(zhi), w, w, lo, hi);
+        out.hi = zhi >= 0 ? Vec(hi, num(1) << w) : Vec(num(1) << w, lo);
+        out.lo = out.lo.scale();
+        out.hi = out.hi.scale();
+        out.bounded = true;
+        return true;
+    }
+};
+
+// f(x) for a real x by nested intervals, as NewtonSqrt does for a rational
+// one. Each stage takes as many more digits of x as it has so far (the
+// sign and newtonBlock digits at first), so x is known to twice the bits,
+// and F narrows the interval f(x) was known to lie in to one about that
+// wide. A node's head takes [0, inf] to the new interval inside the old, and
+// its tail is the next stage on the residual of x. While the interval is
+// unbounded a stage takes digits until F can bound it; that stage's head is
+// the interval itself.
+template<typename F>
+struct NewtonX {
+    F f;
+    Mat seen;     // the digits of x taken so far
+    Interval at;  // where f(x) is known to lie
+    int taken;    // how many digits
+
+    const Expr *operator()(const Expr *x) const {
+        NewtonX next = *this;
+        Interval out;
+        const Expr *rest = x;
+        do {
+            Interval ix;
+            if (const Vec *v = rest->head().dyn_cast<Vec>()) {
+                const Vec p = dot1(next.seen, *v);
+                ix = Interval(&p, 1);
+            } else {
+                Mat m = Mat::identity();
+                const int n = next.taken > 0 ? next.taken : newtonBlock;
+                rest = emitDigits(rest, n, newtonBlock, next.taken > 0, m);
+                next.seen = next.seen.dot(m).scale();
+                ix = Interval::of(next.seen);
+            }
+            next.taken += next.taken > 0 ? next.taken : newtonBlock;
+            if (!f(ix, at, next.taken, out)) {
+                out = at;
+            }
+        } while (!out.bounded);
+        if (at.bounded) {
+            if (out.lo < at.lo) { out.lo = at.lo; }
+            if (at.hi < out.hi) { out.hi = at.hi; }
+        }
+        next.at = out;
+        if (out.lo == out.hi) {
+            return mk<VecExpr>(at.bounded ? dot1(at.to_mat().inverse(), out.lo).scale() : out.lo);
+        }
+        const Mat head = at.bounded ? at.to_mat().inverse().dot(out.to_mat()).scale() : out.to_mat();
+        return mk<MatExpr>(head, delay(next, rest));
+    }
+
+    bool save(CheckpointWriter &w) const {
+        w.u8((uint8_t) Closure::NewtonX);
+        w.u8((uint8_t) F::step);
+        w.vec(seen.v0());
+        w.vec(seen.v1());
+        w.u8(at.bounded);
+        w.vec(at.lo);
+        w.vec(at.hi);
+        w.i32(taken);
+        return true;
+    }
+};
+
+// f(x) for an f that is never negative, so that the whole of NewtonX's
+// chain can be a tail and wait for its first digit to be asked for. Through
+// eblocks for the same reason as NewtonSqrt.
+template<typename F>
+const Expr *enewtonx(F f, const Expr *x) {
+    const NewtonX<F> first{f, Mat::identity(), Interval(), 0};
+    return eblocks(mk<MatExpr>(Mat::identity(), delay(first, x)), newtonBlock);
+}
+
+// sqrt(x), with x < 0 taken as 0. A rational x takes esqrtrat's way.
+const Expr *esqrtspos(const Expr *e) {
+    if (const Vec *v = e->head().dyn_cast<Vec>()) {
+        const Vec x = v->v1 < 0 ? Vec(-v->v0, -v->v1) : *v;
+        if (x.v0 >= 0 && x.v1 > 0) {
+            return esqrtrat(x.v0, x.v1);
+        }
+    }
+    return enewtonx(SqrtStep(), e);
+}
+
+// log x for x > 0, as the difference of its two parts (see LogPart), each
+// a chain that waits for its first digit to be asked for like enewtonx's.
+const Expr *elogpos(const Expr *e) {
+    return app(tsub, enewtonx(LogStep(), e), enewtonx(LogNegStep(), e));
+}
+
+// e^x for any x.
+const Expr *eexp(const Expr *e) {
+    return enewtonx(ExpStep(), e);
+}
+
+// The reciprocal needs no stages of its own: 1/x is an LFT of x, erec.
+
+// w -> (p/q) (w - 1) / (w + 1), which takes [0, inf] onto [-p/q, p/q].
+Mat within(num p, num q) {
+    return Mat(p, q, -p, q);
+}
+
+// Lambert's continued fraction tan x = x / (1 - x^2 / (3 - x^2 / (5 - ...)))
+// as u(n) = x / (2n + 1 - x u(n + 1)), tan x = u(0), for x = szer(y). The
+// argument y is in [0, inf], so |x| <= 1 and then |u(n)| < 1/(2n) for n > 0
+// and |u(0)| < 2. Term n yields w(n) with u(n) = bound(n)(w(n)), so that
+// every tail lies in [0, inf] too (10.2.5).
+struct TanTerms {
+    static const Series series = Series::Tan;
+
+    static Mat bound(int n) { return n == 0 ? within(2, 1) : within(1, 2 * n); }
+
+    Tensor operator()(int n) const {
+        const Tensor u(Mat(0, -1, 1, 0), Mat(0, 0, 0, 2 * n + 1));
+        return bound(n).inverse().dot(u.left(szer).right(bound(n + 1))).scale();
+    }
+};
+
+// the continued fraction arctan x = x / (1 + x^2 / (3 + 4x^2 / (5 + ...)))
+// as u(n) = x / (2n + 1 + (n + 1)^2 x u(n + 1)), arctan x = u(0), for
+// x = szer(y) as in TanTerms. x u(n + 1) >= 0, so |u(n)| <= 1/(2n + 1)
+// (10.2.6).
+struct ArctanTerms {
+    static const Series series = Series::Arctan;
+
+    static Mat bound(int n) { return within(1, 2 * n + 1); }
+
+    Tensor operator()(int n) const {
+        const Tensor u(Mat(0, num(n + 1) * (n + 1), 1, 0), Mat(0, 0, 0, 2 * n + 1));
+        return bound(n).inverse().dot(u.left(szer).right(bound(n + 1))).scale();
+    }
+};
+
+// tan szer(y) for y in [0, inf], that is tan x for |x| <= 1; each term fixes
+// about 2 log2((2n + 1) / |x|) bits. See etan for any x.
+const Expr *etanszer(const Expr *e, int block = 1) {
+    return mk<MatExpr>(TanTerms::bound(0), ExprThunk::thunkify(eiteratex(TanTerms(), 0, e, block)));
+}
+
+// arctan szer(y) for y in [0, inf], fastest for y near 1, x near 0. See
+// earctan for any x.
+const Expr *earctanszer(const Expr *e, int block = 1) {
+    return mk<MatExpr>(ArctanTerms::bound(0), ExprThunk::thunkify(eiteratex(ArctanTerms(), 0, e, block)));
+}
+
+struct ETerms {
+    static const Series series = Series::E;
+
+    Mat operator()(int n) const { return Mat(2 * n + 2, 2 * n + 1, 2 * n + 1, 2 * n); }
+};
+
+// ee = natural exp
+const Expr *ee(int block = 1) {
+    return eiterate(ETerms(), 0, block);
+}
+
+// the omega series of epi.
+struct PiTerms {
+    static const Series series = Series::Pi;
+
+    Mat operator()(int n) const {
+        if (n == 0) {
+            return Mat(6795705, 213440, 6795704, 213440);
+        } else {
+            const num b = num(2 * n - 1) * (6 * n - 5) * (6 * n - 1);
+            const num c = b * (545140134ll * n + 13591409);
+            const num d = b * (n + 1);
+            const num e = 10939058860032000ll * powi(n, 4);
+            return Mat(e - d - c, e + d + c, e + d - c, e - d + c);
+        }
+    }
+};
+
+// Pi: section 10.2.4. block > 1 absorbs that many terms of the series at a
+// time, see eiterate.
+
+const Expr *epi(int block = 1) {
+    const Expr *eomega = eiterate(PiTerms(), 0, block);
+    return mk<TensorExpr>(tdiv, ExprThunk::thunkify(esqrtrat(10005, 1)),
+                          ExprThunk::thunkify(eomega));
+}
+
+// Closure records: the Closure tag, then
+//   Iterate:  series, 0 | 1 and x (an AtVec), n, block
+//   IterateX: series, 0, n
+//   Newton:   p, q, xp, xq
+//   Blocks:   block, signed
+//   NewtonX:  step, the columns of seen, bounded, lo, hi, taken
+// and the index of the bound node. Only the series each builder uses are
+// accepted.
+const ExprThunk *loadClosure(CheckpointReader &r) {
+    const Closure kind = (Closure) r.u8();
+    const ExprThunk *out = nullptr;
+    if (kind == Closure::Newton) {
+        const num p = r.number();
+        const num q = r.number();
+        const num xp = r.number();
+        const num xq = r.number();
+        out = delay(NewtonSqrt{p, q, xp, xq});
+        r.ok = r.ok && r.u32() == CheckpointWriter::none;
+        return r.ok ? out : nullptr;
+    }
+    if (kind == Closure::Blocks) {
+        const int block = r.i32();
+        const bool signed_ = r.u8() != 0;
+        const Expr *arg = r.nodeAt(r.u32());
+        r.ok = r.ok && block >= 1;
+        return r.ok ? delay(Blocks{block, signed_}, arg) : nullptr;
+    }
+    if (kind == Closure::NewtonX) {
+        const Step step = (Step) r.u8();
+        const Vec c0 = r.vec();
+        const Vec c1 = r.vec();
+        Interval at;
+        at.bounded = r.u8() != 0;
+        at.lo = r.vec();
+        at.hi = r.vec();
+        const int taken = r.i32();
+        const Expr *arg = r.nodeAt(r.u32());
+        r.ok = r.ok && taken >= 0;
+        const Mat seen(c0, c1);
+        if (!r.ok) {
+            return nullptr;
+        } else if (step == Step::Sqrt) {
+            out = delay(NewtonX<SqrtStep>{SqrtStep(), seen, at, taken}, arg);
+        } else if (step == Step::Log) {
+            out = delay(NewtonX<LogStep>{LogStep(), seen, at, taken}, arg);
+        } else if (step == Step::LogNeg) {
+            out = delay(NewtonX<LogNegStep>{LogNegStep(), seen, at, taken}, arg);
+        } else if (step == Step::Exp) {
+            out = delay(NewtonX<ExpStep>{ExpStep(), seen, at, taken}, arg);
+        }
+        r.ok = r.ok && out != nullptr;
+        return out;
+    }
+    const Series series = (Series) r.u8();
+    const bool atVec = r.u8() != 0;
+    const Vec x = atVec ? r.vec() : Vec(0, 0);
+    const int n = r.i32();
+    if (kind == Closure::Iterate) {
+        const int block = r.i32();
+        r.ok = r.ok && n >= 0 && block >= 1 && r.u32() == CheckpointWriter::none;
+        auto iterate = [n, block](auto f) { return delay(Iterate<decltype(f)>{f, n, block}); };
+        if (!r.ok) {
+            return nullptr;
+        } else if (series == Series::E && !atVec) {
+            out = iterate(ETerms());
+        } else if (series == Series::Pi && !atVec) {
+            out = iterate(PiTerms());
+        } else if (series == Series::Tan && atVec) {
+            out = iterate(AtVec<TanTerms>{TanTerms(), x});
+        } else if (series == Series::Arctan && atVec) {
+            out = iterate(AtVec<ArctanTerms>{ArctanTerms(), x});
+        }
+    } else if (kind == Closure::IterateX && !atVec) {
+        const Expr *arg = r.nodeAt(r.u32());
+        r.ok = r.ok && n >= 0;
+        if (!r.ok) {
+            return nullptr;
+        } else if (series == Series::Tan) {
+            out = delay(IterateX<TanTerms>{TanTerms(), n}, arg);
+        } else if (series == Series::Arctan) {
+            out = delay(IterateX<ArctanTerms>{ArctanTerms(), n}, arg);
+        }
+    }
+    r.ok = r.ok && out != nullptr;
+    return out;
+}
+
+// A DigitStream checkpoint: the magic, the state of the emission (whether
+// the sign is known, the sign, k, and the digits as n and c), then the graph
+// of the residual.
+static const char checkpointMagic[8] = {'F', 'R', 'A', 'C', 'C', 'K', 'P', '3'};
+
+bool DigitStream::save(const char *path) const {
+    CheckpointWriter w;
+    w.out.append(checkpointMagic, sizeof(checkpointMagic));
+    w.u8(state.signed_);
+    w.u8((uint8_t) state.sign);
+    w.i32(state.k);
+    w.i32(state.d.d0);
+    w.number(state.d.d1);
+    CheckpointWriter g;
+    const uint32_t root = g.graph(state.e);
+    if (!g.ok) {
+        return false;
+    }
+    w.u32(g.records());
+    w.out += g.out;
+    w.u32(root);
+    const std::string tmp = std::string(path) + ".tmp";
+    FILE *f = fopen(tmp.c_str(), "wb");
+    if (!f) {
+        return false;
+    }
+    const bool written = fwrite(w.out.data(), 1, w.out.size(), f) == w.out.size();
+    if (fclose(f) != 0 || !written) {
+        remove(tmp.c_str());
+        return false;
+    }
+    return rename(tmp.c_str(), path) == 0;
+}
+
+// reads the state saved in a checkpoint into out, building the residual in
+// the current arena (or on the heap). False if the file cannot be read.
+bool readCheckpoint(const char *path, Emission &out) {
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    void *base = fstat(fd, &st) == 0 && st.st_size > 0
+                 ? mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (base == MAP_FAILED) {
+        return false;
+    }
+    const char *p = static_cast<const char *>(base);
+    CheckpointReader r(p, p + st.st_size);
+    for (char c : checkpointMagic) {
+        r.ok = r.ok && r.u8() == (uint8_t) c;
+    }
+    const bool signed_ = r.u8() != 0;
+    const uint8_t sign = r.u8();
+    const int k = r.i32();
+    const int d0 = r.i32();
+    const num d1 = r.number();
+    const Expr *e = r.ok ? r.graph() : nullptr;
+    munmap(base, st.st_size);
+    if (!r.ok || sign > (uint8_t) SefpType::Zero || k < 1 || d0 < 0) {
+        return false;
+    }
+    out = Emission(e, 0, signed_);
+    out.sign = (SefpType) sign;
+    out.k = k;
+    out.d = Digits(d0, d1);
+    return true;
+}
+
+std::unique_ptr<DigitStream> DigitStream::load(const char *path) {
+    Emission loaded(nullptr, 0, false);
+    bool ok = false;
+    std::unique_ptr<DigitStream> s(new DigitStream([&]() {
+        ok = readCheckpoint(path, loaded);
+        return loaded.e;
+    }));
+    if (!ok) {
+        return nullptr;
+    }
+    s->state = loaded;
+    return s;
+}
+
+// ===Constant cache===
+// Digits of named constants computed once and kept across processes, as one
+// checkpoint per constant in a directory. constant() maps the file and
+// returns the constant as a process wide heap graph: the cached sign and
+// digits as a single matrix, applied to the residual saved with them. An
+// evaluation that uses it gets those digits without computing any series,
+// and carries on into the residual if it needs more. Asking for more digits
+// than the file holds extends the file first.
+//
+// A constant's graph, once built, stays for the life of the cache:
+// evaluations may still be running on it, and heap nodes are never freed.
+// Extending it runs a stream over that same graph rather than building a
+// second one, so the cells forced on the way memoize where every later
+// evaluation finds them.
+struct ConstantCache {
+    explicit ConstantCache(std::string dir) : dir(std::move(dir)) {}
+
+    ConstantCache(const ConstantCache &) = delete;
+
+    ConstantCache &operator=(const ConstantCache &) = delete;
+
+    // the constant `name` with at least `digits` digits cached. build makes
+    // it from scratch when there is no file yet; if its graph has no
+    // checkpoint form, the result is a plain heap graph of build().
+    const Expr *constant(const std::string &name, const std::function<const Expr *()> &build, int digits = 0) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = loaded.find(name);
+        if (it != loaded.end() && it->second.first >= digits) {
+            return it->second.second;
+        }
+        const std::string file = path(name);
+        if (it != loaded.end()) {
+            const Expr *e = it->second.second;
+            DigitStream s(e);
+            s.more(digits);
+            Stats::get().cacheComputed += s.digits() - it->second.first;
+            // the digits are in memory either way; a file that cannot be
+            // written only costs the next process the time to recompute them.
+            s.save(file.c_str());
+            it->second.first = s.digits();
+            return e;
+        }
+        std::unique_ptr<DigitStream> s = DigitStream::load(file.c_str());
+        if (!s) {
+            s.reset(new DigitStream(build));
+        }
+        const int stored = s->digits();
+        if (stored < digits || !s->signedYet()) {
+            s->more(std::max(0, digits - stored));
+            Stats::get().cacheComputed += s->digits() - stored;
+            if (!s->save(file.c_str())) {
+                ArenaScope heap(nullptr);
+                return build();
+            }
+        }
+        ArenaScope heap(nullptr);
+        Emission state(nullptr, 0, false);
+        if (!readCheckpoint(file.c_str(), state) || !state.signed_) {
+            return build();
+        }
+        const Expr *e = Sefp(state.sign, Uefp(state.d, state.e)).to_expr();
+        Stats::get().cacheRead += std::min(stored, state.d.d0);
+        loaded[name] = {state.d.d0, e};
+        return e;
+    }
+
+    // digits of `name` in memory, 0 if none.
+    int cachedDigits(const std::string &name) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = loaded.find(name);
+        return it == loaded.end() ? 0 : it->second.first;
+    }
+
+private:
+    std::string path(const std::string &name) const { return dir + "/" + name + ".ckpt"; }
+
+    const std::string dir;
+    std::mutex mutex;
+    std::map<std::string, std::pair<int, const Expr *>> loaded;  // digits known and graph, by name
+};
+
+// The process wide graphs of pi and e, built on the heap on first use. Their
+// thunks memoize on the heap, so every evaluation that starts from them, on
+// any thread, reuses the terms of the series forced so far.
+const Expr *epiShared() {
+    static const Expr *const e = []() {
+        ArenaScope heap(nullptr);
+        return epi();
+    }();
+    return e;
+}
+
+const Expr *eeShared() {
+    static const Expr *const e = []() {
+        ArenaScope heap(nullptr);
+        return ee();
+    }();
+    return e;
+}
+
+// ===Trigonometric functions===
+// etanszer and earctanszer converge fast only for small arguments, and
+// their terms only collapse into matrices for a rational one. The functions
+// below bring any argument there. They take the nearest multiple of pi
+// (epiShared) off the argument of tan, sin and cos, and halve what is left
+// where the series needs it, doubling back after. A real argument is then
+// split into a rational r near it and a small real d. The formulas
+// tan(r + d) = (tan r + tan d) / (1 - tan r tan d) and
+// arctan x = arctan r + arctan((x - r) / (1 + r x)) give the rational part
+// to the fast series. The series in d absorbs d's digits at every term, but
+// each term fixes about 2 * trigSplit bits, so it needs few terms.
+//
+// The engine takes every argument of a node to lie in [0, inf], so none of
+// these signed values is ever an argument itself. Each is built as a matrix
+// or tensor over unsigned nodes (pi, the series, the digits of x) and
+// combined with app, which folds those heads into the combining tensor.
+// d reaches its series through eblocks: a series takes an argument's heads
+// as they come, and while they leave [0, inf] no tail can emit, so each tail
+// in turn pushes its own tail after the digits it lacks.
+
+static const int trigSplit = 32;   // bits of r
+static const int trigBlock = 16;   // terms per matrix of a series at a rational
+static const int trigDigits = 64;  // digits of x and of d per head
+
+// (x + y) / (1 - xy), 2x / (1 + x^2) and (1 - x^2) / (1 + x^2): tan of a
+// sum, and sin and cos of 2 arctan x.
+const Tensor ttanadd(Mat(0, -1, 1, 0), Mat(1, 0, 0, 1));
+const Tensor tsinhalf(Mat(0, 1, 1, 0), Mat(1, 0, 0, 1));
+const Tensor tcoshalf(Mat(-1, 1, 0, 0), Mat(0, 0, 1, 1));
+
+// round(a / b), halves up.
+num roundDiv(num a, num b) {
+    if (b < 0) {
+        a = -a;
+        b = -b;
+    }
+    const num n = 2 * a + b, d = 2 * b;
+    const num q = n / d;
+    return n < 0 && q * d != n ? q - 1 : q;
+}
+
+// a rational within 2^-bits of x, over 2^bits.
+Vec nearby(const Expr *x, int bits) {
+    const Interval i = Interval::of(eapprox(x, bits + 1));
+    const num p = i.lo.v0 * i.hi.v1 + i.hi.v0 * i.lo.v1, q = 2 * i.lo.v1 * i.hi.v1;
+    return Vec(roundDiv(p << bits, q), num(1) << bits).scale();
+}
+
+// p/q pi, as a node over pi.
+const Expr *epiTimes(num p, num q) {
+    return mk<MatExpr>(Mat(p, 0, 0, q), ExprThunk::thunkify(epiShared()));
+}
+
+// x as a node over a single unsigned tail, s(u) with u = s^-1(x), for x in
+// the range of s.
+const Expr *ethrough(const Mat &s, const Expr *x) {
+    return mk<MatExpr>(s, ExprThunk::thunkify(app(s.inverse(), x)));
+}
+
+// x over unsigned tails: its sign and first digits over the rest.
+const Expr *eunsigned(const Expr *x) {
+    return x->head().isa<Vec>() ? x : Blocks{trigDigits, false}(x);
+}
+
+// x - k pi for the integer k nearest x / pi, so within about pi/2 + 1/4.
+const Expr *ereducepi(const Expr *x, num &k) {
+    const Vec r = nearby(x, 2);
+    const Vec pi = nearby(epiShared(), std::max(0, bitLength(r.v0) - bitLength(r.v1)) + 4);
+    k = roundDiv(r.v0 * pi.v1, r.v1 * pi.v0);
+    const Expr *u = eunsigned(x);
+    return k == 0 ? u : app(tsub, u, epiTimes(k, 1));
+}
+
+// tan x for |x| <= 2, from x over unsigned tails.
+const Expr *etanreduced(const Expr *x) {
+    if (const Vec *v = x->head().dyn_cast<Vec>()) {
+        if (abs(v->v0) <= abs(v->v1)) {
+            return etanszer(mk<VecExpr>(dot1(iszer, *v)), trigBlock);
+        }
+        const Expr *t = etanszer(mk<VecExpr>(dot1(iszer.dot(Mat(1, 0, 0, 2)), *v)), trigBlock);
+        return ethrough(sinf, app(ttanadd, t, t));
+    }
+    const Vec r = nearby(x, trigSplit);
+    const Expr *d = app(iszer.dot(Mat(r.v1, 0, -r.v0, r.v1)), x);
+    return app(ttanadd, etanreduced(mk<VecExpr>(r)), etanszer(eblocks(d, trigDigits)));
+}
+
+// tangent: Section 10.2.5
+const Expr *etan(const Expr *x) {
+    num k;
+    return etanreduced(ereducepi(x, k));
+}
+
+// sin and cos of x - k pi through t = tan((x - k pi) / 2), |t| <= 1.3,
+// and negated for an odd k.
+const Expr *ehalftan(const Expr *x, num &k) {
+    const Expr *t = etanreduced(app(Mat(1, 0, 0, 2), ereducepi(x, k)));
+    return t->head().branch() == 1 ? t : ethrough(within(2, 1), t);
+}
+
+const Expr *esin(const Expr *x) {
+    num k;
+    const Expr *t = ehalftan(x, k);
+    return app(Mat(k % 2 == 0 ? 1 : -1, 0, 0, 1).dot(tsinhalf), t, t);
+}
+
+const Expr *ecos(const Expr *x) {
+    num k;
+    const Expr *t = ehalftan(x, k);
+    return app(Mat(k % 2 == 0 ? 1 : -1, 0, 0, 1).dot(tcoshalf), t, t);
+}
+
+// arc tangent: Section 10.2.6. A rational r > 1/2 goes through
+// arctan r = pi/4 + arctan((r - 1) / (r + 1)) up to 2, and
+// arctan r = pi/2 - arctan(1/r) beyond, so that the series always sees
+// at most 1/2.
+const Expr *earctan(const Expr *x) {
+    if (const Vec *v = x->head().dyn_cast<Vec>()) {
+        const Vec r = v->v1 < 0 ? Vec(-v->v0, -v->v1) : *v;
+        if (r.v0 < 0) {
+            return app(Mat(-1, 0, 0, 1), earctan(mk<VecExpr>(Vec(-r.v0, r.v1))));
+        } else if (2 * r.v0 <= r.v1) {
+            return earctanszer(mk<VecExpr>(dot1(iszer, r)), trigBlock);
+        } else if (r.v0 <= 2 * r.v1) {
+            const Vec s(r.v0 - r.v1, r.v0 + r.v1);
+            return app(tadd, epiTimes(1, 4), earctanszer(mk<VecExpr>(dot1(iszer, s)), trigBlock));
+        } else {
+            const Vec s(r.v1, r.v0);
+            return app(tsub, epiTimes(1, 2), earctanszer(mk<VecExpr>(dot1(iszer, s)), trigBlock));
+        }
+    }
+    const Vec r = nearby(x, trigSplit);
+    const Expr *a = earctan(mk<VecExpr>(r));
+    if (a->head().branch() != 1) {
+        a = ethrough(within(2, 1), a);
+    }
+    const Expr *d = app(iszer.dot(Mat(r.v1, r.v0, -r.v0, r.v1)), eunsigned(x));
+    return app(tadd, a, earctanszer(eblocks(d, trigDigits)));
+}
+
+// ===Evaluation server===
+// A long running process that answers queries for digits, so that nothing
+// is paid per process and constants stay warm from one query to the next.
+// A query is one line,
+//
+//     <id> <digits> <expr>
+//
+// where expr is made of the constructors epi, ee, esqrtrat(p, q),
+// esqrtspos(x), elogpos(x), eexp(x), etan(x), esin, ecos, earctan,
+// tadd(x, y), tsub, tmul and tdiv, and the rationals p and p/q. The answer
+// streams back as lines
+//
+//     <id> <digits so far> <value>
+//
+// one per step of evaluation, then "<id> done", or just "<id> error <why>"
+// for a query that cannot be parsed.
+//
+// epi and ee are the process wide heap graphs, so the terms of their series
+// are computed once for the life of the server. With a ConstantCache they
+// come from its files instead, extended to the digits of each query that
+// asks for more than they hold, so a restarted server starts from there.
+// The queries in hand run as one batch: each round advances every query by
+// one step, so the queries that need a constant force its terms together,
+// and every query sees its first digits early. The nodes of a batch share
+// one arena, so a subexpression that several queries contain is built and
+// advanced once (see LFT::cons and advanced()). Queries that arrive while a
+// batch runs join it at the next round, as long as its arena is within the
+// budget, and the arena is reset whenever the batch drains.
+
+// Recursive descent over the expression part of a query, building in the
+// current arena. expr() returns nullptr and sets error on bad input.
+struct QueryParser {
+    // digits is what the query asks for, and how far a cached constant is
+    // extended (and kept) for it.
+    QueryParser(const char *p, ConstantCache *cache, int digits) : p(p), cache(cache), digits(digits) {};
+
+    const Expr *expr() {
+        const Expr *e = term(0);
+        skip();
+        if (e && *p != '\0') {
+            return fail("trailing input");
+        }
+        return e;
+    }
+
+    std::string error;
+
+private:
+    static constexpr int maxDepth = 256;
+
+    const Expr *fail(const char *why) {
+        if (error.empty()) { error = why; }
+        return nullptr;
+    }
+
+    void skip() {
+        while (*p == ' ' || *p == '\t') { ++p; }
+    }
+
+    bool eat(char c) {
+        skip();
+        if (*p != c) { return false; }
+        ++p;
+        return true;
+    }
+
+    bool number(num &out) {
+        skip();
+        const bool neg = *p == '-';
+        if (neg) { ++p; }
+        if (*p < '0' || *p > '9') { return false; }
+        out = 0;
+        while (*p >= '0' && *p <= '9') {
+            out = out * 10 + (*p++ - '0');
+        }
+        if (neg) { out = -out; }
+        return true;
+    }
+
+    bool rational(num &a, num &b) {
+        b = 1;
+        if (!number(a) || (eat('/') && !number(b))) {
+            return false;
+        }
+        return b != 0;
+    }
+
+    const Expr *term(int depth) {
+        skip();
+        if (depth > maxDepth) {
+            return fail("nested too deeply");
+        }
+        if (*p == '-' || (*p >= '0' && *p <= '9')) {
+            num a, b;
+            if (!rational(a, b)) { return fail("bad rational"); }
+            return mk<VecExpr>(Vec(a, b));
+        }
+        const char *start = p;
+        while ((*p >= 'a' && *p <= 'z') || (*p >= '0' && *p <= '9')) { ++p; }
+        const std::string name(start, p);
+        if (name == "epi") {
+            return cache ? cache->constant("pi", []() { return epi(); }, digits) : epiShared();
+        }
+        if (name == "ee") {
+            return cache ? cache->constant("e", []() { return ee(); }, digits) : eeShared();
+        }
+        if (!eat('(')) {
+            return fail(name.empty() ? "expected an expression" : "expected (");
+        }
+        const Expr *out = nullptr;
+        if (name == "esqrtrat") {
+            num a, b;
+            if (!number(a) || !eat(',') || !number(b)) { return fail("esqrtrat takes two integers"); }
+            if (a < 0 || b <= 0) { return fail("esqrtrat of a negative rational"); }
+            out = constant("sqrt", Vec(a, b), esqrtrat);
+        } else if (name == "esqrtspos" || name == "elogpos") {
+            const Expr *x = term(depth + 1);
+            if (!x) { return nullptr; }
+            const int s = sign(x);
+            if (s <= 0) {
+                return fail(s < 0 ? "argument is not positive" : "cannot tell the argument is positive");
+            }
+            if (const Vec *v = x->head().dyn_cast<Vec>()) {
+                out = name == "esqrtspos" ? constant("sqrt", *v, esqrtrat)
+                    : constant("log", *v, [](num p, num q) { return elogpos(mk<VecExpr>(Vec(p, q))); });
+            } else {
+                out = name == "esqrtspos" ? esqrtspos(x) : elogpos(x);
+            }
+        } else if (name == "eexp" || name == "etan" || name == "esin" || name == "ecos" || name == "earctan") {
+            const Expr *x = term(depth + 1);
+            if (!x) { return nullptr; }
+            out = name == "eexp" ? eexp(x) : name == "etan" ? etan(x) : name == "esin" ? esin(x)
+                : name == "ecos" ? ecos(x) : earctan(x);
+        } else if (const Tensor *t = tensor(name)) {
+            const Expr *x = argument(depth + 1);
+            const Expr *y = x && eat(',') ? argument(depth + 1) : nullptr;
+            if (!y) { return fail("expected two arguments"); }
+            out = app(*t, x, y);
+        } else {
+            return fail("unknown constructor");
+        }
+        return eat(')') ? out : fail("expected )");
+    }
+
+    // an argument of a tensor as a matrix over unsigned tails, for app to
+    // fold into it: the engine takes every argument of a node to lie in
+    // [0, inf]. A value that may be negative has its sign and first digits
+    // taken off (eunsigned); the constructors that are never negative stay
+    // whole under the identity.
+    const Expr *argument(int depth) {
+        skip();
+        const char *end = p;
+        while ((*end >= 'a' && *end <= 'z') || (*end >= '0' && *end <= '9')) { ++end; }
+        const std::string name(p, end);
+        const Expr *x = term(depth);
+        if (!x || x->head().isa<Vec>()) {
+            return x;
+        }
+        for (const char *n : {"epi", "ee", "esqrtrat", "esqrtspos", "eexp"}) {
+            if (name == n) {
+                return mk<MatExpr>(Mat::identity(), ExprThunk::thunkify(x));
+            }
+        }
+        return eunsigned(x);
+    }
+
+    // f(p, q) for the rational v = p/q >= 0, through the cache under
+    // `fn`-p-q when there is one, so that square roots and logarithms of
+    // rationals are kept across queries and processes like pi and e.
+    const Expr *constant(const char *fn, const Vec &v, const Expr *(*f)(num, num)) {
+        const Vec r = (v.v1 < 0 ? Vec(-v.v0, -v.v1) : v).scale();
+        if (!cache) {
+            return f(r.v0, r.v1);
+        }
+        const std::string name = std::string(fn) + "-" + r.v0.str() + "-" + r.v1.str();
+        return cache->constant(name, [f, r]() { return f(r.v0, r.v1); }, digits);
+    }
+
+    // 1 if x is known to be positive, -1 if it is known not to be, within
+    // signSteps turns of run() and signDigits digits, else 0. A query runs
+    // on the serve thread until it is parsed, and x may take long or
+    // forever to settle (0 does).
+    static int sign(const Expr *x) {
+        static const long signSteps = 1 << 14;
+        static const int signDigits = 1024;
+        if (const Vec *v = x->head().dyn_cast<Vec>()) {
+            return sgn(v->v0) * sgn(v->v1) > 0 ? 1 : -1;
+        }
+        long steps = signSteps;
+        Emission s(x, 0, false);
+        while (steps > 0 && s.d.d0 < signDigits) {
+            s.j = 16;
+            s = run(s, &steps);
+            const Interval i = Interval::of(Sefp(s.sign, Uefp(s.d, s.e)).to_mat());
+            if (s.signed_ && i.bounded && i.lo.v0 > 0) {
+                return 1;
+            }
+            if (s.signed_ && i.bounded && i.hi.v0 <= 0) {
+                return -1;
+            }
+            if (s.e->head().isa<Vec>()) {
+                break;
+            }
+        }
+        return 0;
+    }
+
+    static const Tensor *tensor(const std::string &name) {
+        if (name == "tadd") { return &tadd; }
+        if (name == "tsub") { return &tsub; }
+        if (name == "tmul") { return &tmul; }
+        if (name == "tdiv") { return &tdiv; }
+        return nullptr;
+    }
+
+    const char *p;
+    ConstantCache *const cache;
+    const int digits;
+};
+
+// one client: where its queries come from and its answers go. The
+// descriptors are closed with the last reference, once the client has hung
+// up and its queries are done.
+struct Connection {
+    Connection(int in, int out, bool owned) : in(in), out(out), owned(owned) {};
+
+    Connection(const Connection &) = delete;
+
+    Connection &operator=(const Connection &) = delete;
+
+    ~Connection() {
+        if (owned) {
+            close(in);
+            if (out != in) { close(out); }
+        }
+    }
+
+    // write a line; false, and nothing more is written, once the client is
+    // gone. Only the evaluating thread writes.
+    bool send(const std::string &line) {
+        size_t off = 0;
+        while (!gone && off < line.size()) {
+            const ssize_t n = write(out, line.data() + off, line.size() - off);
+            if (n < 0 && errno == EINTR) { continue; }
+            if (n <= 0) { gone = true; }
+            else { off += n; }
+        }
+        return !gone;
+    }
+
+    const int in, out;
+    const bool owned;
+    bool gone = false;
+};
+
+struct Server {
+    explicit Server(ConstantCache *cache = nullptr) : cache(cache) { arena.retain(); }
+
+    Server(const Server &) = delete;
+
+    Server &operator=(const Server &) = delete;
+
+    ~Server() {
+        stop();
+        arena.release();
+    }
+
+    // queue a query line from c, from any thread.
+    void submit(const std::shared_ptr<Connection> &c, std::string line) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back({c, std::move(line)});
+        }
+        wake.notify_one();
+    }
+
+    // no more queries are coming; serve() returns once the queued ones are
+    // answered.
+    void finish() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished = true;
+        }
+        wake.notify_one();
+    }
+
+    // submit every line read from c until it hangs up.
+    void readLines(const std::shared_ptr<Connection> &c) {
+        static constexpr size_t maxLine = 1 << 20;
+        std::string buf;
+        char block[4096];
+        for (;;) {
+            const ssize_t n = read(c->in, block, sizeof block);
+            if (n < 0 && errno == EINTR) { continue; }
+            if (n <= 0) { break; }
+            buf.append(block, n);
+            size_t start = 0, end;
+            while ((end = buf.find('\n', start)) != std::string::npos) {
+                submit(c, buf.substr(start, end - start));
+                start = end + 1;
+            }
+            buf.erase(0, start);
+            if (buf.size() > maxLine) { break; }
+        }
+        if (!buf.empty() && buf.size() <= maxLine) {
+            submit(c, buf);
+        }
+    }
+
+    // accept clients on a Unix domain socket at path, each on a thread of
+    // its own that reads its queries, until the Server is destroyed. False if
+    // the socket cannot be set up.
+    bool listen(const char *path) {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (strlen(path) >= sizeof addr.sun_path) {
+            return false;
+        }
+        strcpy(addr.sun_path, path);
+        const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) {
+            return false;
+        }
+        unlink(path);
+        if (bind(fd, (const sockaddr *) &addr, sizeof addr) != 0 || ::listen(fd, 16) != 0) {
+            close(fd);
+            return false;
+        }
+        listenFd = fd;
+        acceptor = std::thread([this]() {
+            for (;;) {
+                const int c = accept(listenFd, nullptr, nullptr);
+                if (c < 0) {
+                    if (errno == EINTR || errno == ECONNABORTED) { continue; }
+                    break;
+                }
+                std::lock_guard<std::mutex> lock(readersMutex);
+                if (stopping) {
+                    close(c);
+                    break;
+                }
+                for (const std::unique_ptr<Reader> &r : readers) {
+                    if (r->done && r->thread.joinable()) { r->thread.join(); }
+                }
+                readers.erase(std::remove_if(readers.begin(), readers.end(), [](const std::unique_ptr<Reader> &r) {
+                    return !r->thread.joinable();
+                }), readers.end());
+                std::unique_ptr<Reader> r(new Reader);
+                const std::shared_ptr<Connection> conn = std::make_shared<Connection>(c, c, true);
+                Reader *const rp = r.get();
+                r->conn = conn;
+                r->thread = std::thread([this, conn, rp]() {
+                    readLines(conn);
+                    rp->done = true;
+                });
+                readers.push_back(std::move(r));
+            }
+            finish();
+        });
+        return true;
+    }
+
+    // answer queries on this thread until finish() and the last of them.
+    void serve() {
+        for (;;) {
+            std::deque<std::pair<std::shared_ptr<Connection>, std::string>> incoming;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                if (jobs.empty()) {
+                    wake.wait(lock, [this]() { return finished || !queue.empty(); });
+                    if (queue.empty()) { return; }
+                }
+                if (jobs.empty() || arena.bytesInUse() < budget) {
+                    incoming.swap(queue);
+                }
+            }
+            for (auto &q : incoming) {
+                start(q.first, q.second);
+            }
+            for (Job &job : jobs) {
+                step(job);
+            }
+            jobs.erase(std::remove_if(jobs.begin(), jobs.end(), [](const Job &j) { return j.done; }), jobs.end());
+            if (jobs.empty()) {
+                arena.reset();
+            }
+        }
+    }
+
+    // arena bytes past which a running batch takes no more queries.
+    size_t budget = 64 << 20;
+
+private:
+    static constexpr int chunk = 64;  // digits per query per round
+    static constexpr int maxDigits = 1 << 20;
+
+    // the thread reading one socket client's queries.
+    struct Reader {
+        std::thread thread;
+        std::weak_ptr<Connection> conn;
+        std::atomic<bool> done{false};
+    };
+
+    struct Job {
+        std::shared_ptr<Connection> conn;
+        std::string id;
+        int digits;
+        Emission state;
+        bool done = false;
+    };
+
+    void start(const std::shared_ptr<Connection> &c, const std::string &line) {
+        const size_t a = line.find_first_not_of(" \t\r");
+        if (a == std::string::npos) {
+            return;
+        }
+        const size_t b = std::min(line.find_first_of(" \t", a), line.size());
+        const std::string id = line.substr(a, b - a);
+        char *rest;
+        errno = 0;
+        const long digits = strtol(line.c_str() + b, &rest, 10);
+        if (rest == line.c_str() + b || errno != 0 || digits < 0 || digits > maxDigits) {
+            c->send(id + " error expected a digit count\n");
+            return;
+        }
+        std::string text(rest);
+        text.erase(std::min(text.find_last_not_of(" \t\r") + 1, text.size()));
+        ArenaScope scope(arena);
+        QueryParser parser(text.c_str(), cache, (int) digits);
+        const Expr *e = parser.expr();
+        if (!e) {
+            c->send(id + " error " + parser.error + "\n");
+            return;
+        }
+        jobs.push_back({c, id, (int) digits, Emission(e, 0, false)});
+    }
+
+    // one round's worth of a query, and its digits so far.
+    void step(Job &job) {
+        if (job.conn->gone) {
+            job.done = true;
+            return;
+        }
+        {
+            ArenaScope scope(arena);
+            job.state.j = std::min(chunk, job.digits - job.state.d.d0);
+            job.state = run(job.state);
+        }
+        const Emission &s = job.state;
+        job.done = s.d.d0 >= job.digits || s.e->head().isa<Vec>();
+        std::string line = job.id + " " + std::to_string(s.d.d0) + " " +
+                           mshow(Sefp(s.sign, Uefp(s.d, s.e)).to_mat()) + "\n";
+        if (job.done) {
+            line += job.id + " done\n";
+        }
+        job.conn->send(line);
+    }
+
+    // wakes the accept thread and the readers blocked on their sockets, and
+    // joins them all.
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(readersMutex);
+            stopping = true;
+            if (listenFd >= 0) { shutdown(listenFd, SHUT_RDWR); }
+            for (const std::unique_ptr<Reader> &r : readers) {
+                if (std::shared_ptr<Connection> c = r->conn.lock()) { shutdown(c->in, SHUT_RDWR); }
+            }
+        }
+        if (acceptor.joinable()) { acceptor.join(); }
+        for (const std::unique_ptr<Reader> &r : readers) {
+            if (r->thread.joinable()) { r->thread.join(); }
+        }
+        if (listenFd >= 0) { close(listenFd); }
+    }
+
+    ConstantCache *const cache;
+    Arena arena;
+    int listenFd = -1;
+    std::thread acceptor;
+    std::vector<std::unique_ptr<Reader>> readers;  // by the accept thread, under readersMutex
+    std::mutex readersMutex;
+    bool stopping = false;
+    std::vector<Job> jobs;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<std::pair<std::shared_ptr<Connection>, std::string>> queue;
+    bool finished = false;
+};
+
+#ifndef FRACTIONS_NO_MAIN
+// usage: fractions [-s [socket]] [-jthreads] [-cdir] [-astrategy]
+//
+// -s serves queries (see Evaluation server) on stdin and stdout, or on a
+// Unix domain socket at the given path. -j evaluates with a Pool of that
+// many workers, -c takes epi and ee from a ConstantCache in dir, -a absorbs
+// by the named Strategy. With no -s, prints pi to a few places.
+int main(int argc, char **argv) {
+    bool serve = false;
+    const char *socketPath = nullptr;
+    int threads = 0;
+    const char *cacheDir = nullptr;
+    const Strategy *strategy = Strategy::current();
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-s") == 0) {
+            serve = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-') { socketPath = argv[++i]; }
+        } else if (strncmp(argv[i], "-j", 2) == 0) {
+            threads = atoi(argv[i] + 2);
+        } else if (strncmp(argv[i], "-c", 2) == 0) {
+            cacheDir = argv[i] + 2;
+        } else if (strncmp(argv[i], "-a", 2) == 0) {
+            if (!(strategy = Strategy::byName(argv[i] + 2))) {
+                cerr << "unknown strategy " << argv[i] + 2 << "\n";
+                return 1;
+            }
+        }
+    }
+    StrategyScope absorbing(strategy);
+    if (serve) {
+        signal(SIGPIPE, SIG_IGN);
+        std::unique_ptr<Pool> pool(threads > 0 ? new Pool(threads) : nullptr);
+        PoolScope scope(pool.get());
+        std::unique_ptr<ConstantCache> cache(cacheDir ? new ConstantCache(cacheDir) : nullptr);
+        Server server(cache.get());
+        if (socketPath) {
+            if (!server.listen(socketPath)) {
+                perror(socketPath);
+                return 1;
+            }
+            server.serve();
+        } else {
+            std::thread reader([&server]() {
+                server.readLines(std::make_shared<Connection>(0, 1, false));
+                server.finish();
+            });
+            server.serve();
+            reader.join();
+        }
+        cerr << Stats::get() << "\n";
+        return 0;
+    }
+    DigitStream pi([]() { return epi(); });
     for (int i = 0; i < 10; ++i) {
-        cerr << "pi upto " << i << "places: " << eshow(epi(), i);
+        pi.more(i - pi.digits());
+        cerr << "pi upto " << i << "places: " << pi.show() << "\n";
     }
+    cerr << Stats::get() << "\n";
+#if FRACTIONS_TRACE
+    Trace::get().dump("fraction.trace");
+#endif
     return 0;
 }
+#endif